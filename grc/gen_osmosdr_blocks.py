@@ -246,26 +246,32 @@ Lines ending with ... mean it's possible to bind devices together by specifying
 
 #if $sourk == 'source':
   fcd=0[,device=hw:2][,type=2]
-  miri=0[,buffers=32] ...
+  miri=0[,buffers=32][,prefill=3][,latency=ms] ...
   rtl=serial_number ...
   rtl=0[,rtl_xtal=28.8e6][,tuner_xtal=28.8e6] ...
-  rtl=1[,buffers=32][,buflen=N*512] ...
+  rtl=1[,buffers=32][,buflen=N*512][,prefill=3][,latency=ms] ...
   rtl=2[,direct_samp=0|1|2][,offset_tune=0|1] ...
-  rtl_tcp=127.0.0.1:1234[,psize=16384][,direct_samp=0|1|2][,offset_tune=0|1] ...
-  osmosdr=0[,buffers=32][,buflen=N*512] ...
+  rtl=3[,spin=usec][,loan=0|1] ...
+  rtl_tcp=127.0.0.1:1234[,psize=16384][,readahead_ms=250][,rcvbuf=4194304][,reconnect=0|1][,gap=zero|drop|tag][,format=cu8|cu4|cs16|delta][,decim=4][,direct_samp=0|1|2][,offset_tune=0|1] ...
+  osmosdr=0[,buffers=32][,buflen=N*512][,prefill=3][,latency=ms] ...
   file='/path/to/your file',rate=1e6[,freq=100e6][,repeat=true][,throttle=true] ...
-  netsdr=127.0.0.1[:50000][,nchan=2]
-  sdr-ip=127.0.0.1[:50000]
-  cloudiq=127.0.0.1[:50000]
+  netsdr=127.0.0.1[:50000][,nchan=2][,format=16|24][,gap=zero|drop|tag]
+  sdr-ip=127.0.0.1[:50000][,format=16|24][,gap=zero|drop|tag]
+  cloudiq=127.0.0.1[:50000][,format=16|24][,gap=zero|drop|tag]
   sdr-iq=/dev/ttyUSB0
-  airspy=0[,bias=0|1][,linearity][,sensitivity]
+  airspy=0[,bias=0|1][,linearity][,sensitivity][,pack=0|1][,format=cf32|cs16]
 #end if
 #if $sourk == 'sink':
   file='/path/to/your file',rate=1e6[,freq=100e6][,append=true][,throttle=true] ...
 #end if
-  redpitaya=192.168.1.100[:1001]
-  hackrf=0[,buffers=32][,bias=0|1][,bias_tx=0|1]
-  bladerf=0[,tamer=internal|external|external_1pps][,smb=25e6]
+#if $sourk == 'source':
+  redpitaya=192.168.1.100[:1001][,readahead_ms=250][,rcvbuf=4194304]
+#else
+  redpitaya=192.168.1.100[:1001][,ptt=0|1][,tx_latency_ms=100]
+#end if
+  soapy=0[,driver=lime|plutosdr|...][,format=cf32|cs16|cs12|cs8]
+  hackrf=0[,buffers=32][,bias=0|1][,bias_tx=0|1][,tx_latency_ms=ms]
+  bladerf=0[,tamer=internal|external|external_1pps][,smb=25e6][,latency=ms|throughput]
   uhd[,serial=...][,lo_offset=0][,mcr=52e6][,nchan=2][,subdev='\\\\'B:0 A:0\\\\''] ...
 
 Num Channels:
@@ -371,6 +371,29 @@ public:
    * \param time_spec the new time
    */
   virtual void set_time_unknown_pps(const ::osmosdr::time_spec_t &time_spec) = 0;
+
+  /*!
+   * Get how often the device ran out of samples to transmit since the
+   * stream was started.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the count, 0 if the device does not track underruns
+   */
+  virtual unsigned long get_underruns(size_t mboard = 0) = 0;
+
+  /*!
+   * Get how many seconds of samples are buffered between this block and
+   * the device.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the latency in seconds, 0 if unknown
+   */
+  virtual double get_latency(size_t mboard = 0) = 0;
+
+  /*!
+   * Get the highest latency seen since the stream was started.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the latency in seconds, 0 if unknown
+   */
+  virtual double get_max_latency(size_t mboard = 0) = 0;
 };
 
 } /* namespace osmosdr */
@@ -415,6 +415,51 @@ public:
    * \param time_spec the new time
    */
   virtual void set_time_unknown_pps(const ::osmosdr::time_spec_t &time_spec) = 0;
+
+  /*!
+   * Get the number of samples the device lost since it was opened,
+   * through overflows or dropped network packets.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the cumulative count, 0 if the device does not track losses
+   */
+  virtual uint64_t get_dropped_samples(size_t mboard = 0) = 0;
+
+  /*!
+   * Get how often the buffers between the device and this block ran
+   * full since the device was opened, each episode counted once.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the count, 0 if the device does not track overruns
+   */
+  virtual unsigned long get_overruns(size_t mboard = 0) = 0;
+
+  /*!
+   * Get how often the device stopped delivering samples for a while
+   * since it was opened, each episode counted once.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the count, 0 if the device does not track underruns
+   */
+  virtual unsigned long get_underruns(size_t mboard = 0) = 0;
+
+  /*!
+   * Get how many seconds of samples the device buffers before they reach
+   * this block.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the latency in seconds, 0 if unknown
+   */
+  virtual double get_latency(size_t mboard = 0) = 0;
+
+  /*!
+   * Get the hardware timestamp of the first sample of the latest block of
+   * samples, for devices that timestamp their stream. GNU Radio builds
+   * also get them as rx_time tags.
+   * \param item receives the absolute index of that sample in the output
+   * \param timestamp receives its timestamp in device ticks
+   * \param dropped receives the samples lost to overruns so far
+   * \param mboard the motherboard index 0 to M-1
+   * \return false if there is no timestamp (yet)
+   */
+  virtual bool get_rx_timestamp(uint64_t &item, uint64_t &timestamp,
+                                uint64_t &dropped, size_t mboard = 0) = 0;
 };
 
 } /* namespace osmosdr */
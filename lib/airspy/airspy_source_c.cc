@@ -33,7 +33,6 @@
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
-#include <boost/detail/endian.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/thread/thread.hpp>
 
@@ -42,9 +41,12 @@
 #include "airspy_source_c.h"
 
 #include "arg_helpers.h"
+#include "convert.h"
 
 using namespace boost::assign;
 
+#define FIFO_DURATION 0.05 /* seconds of samples buffered for work() */
+
 #define AIRSPY_THROW_ON_ERROR(ret, msg) \
   if ( ret != AIRSPY_SUCCESS )  \
   throw std::runtime_error( boost::str( boost::format(msg " (%d) %s") \
@@ -80,6 +82,8 @@ airspy_source_c::airspy_source_c (const std::string &args)
         gr::io_signature::make(MIN_IN, MAX_IN, sizeof (gr_complex)),
         gr::io_signature::make(MIN_OUT, MAX_OUT, sizeof (gr_complex))),
     _dev(NULL),
+    _int16(false),
+    _fifo(NULL),
     _sample_rate(0),
     _center_freq(0),
     _freq_corr(0),
@@ -161,12 +165,29 @@ airspy_source_c::airspy_source_c (const std::string &args)
     bool pack = boost::lexical_cast<bool>( dict["pack"] );
     int ret = airspy_set_packing(_dev, (uint8_t)pack);
     AIRSPY_THROW_ON_ERROR(ret, "Failed to set USB bit packing")
+
+    /* packing targets low overhead, so skip libairspy's float stage too */
+    _int16 = pack;
+  }
+
+/* let libairspy deliver 16 bit I/Q, which its integer filter produces with
+ * less work than float, and scale it ourselves while filling the FIFO */
+  if ( dict.count( "format" ) )
+  {
+    std::string format = dict["format"];
+
+    if ( "cs16" == format || "int16" == format )
+      _int16 = true;
+    else if ( "cf32" == format || "float" == format )
+      _int16 = false;
+    else
+      throw std::runtime_error( "Unsupported sample format: " + format );
   }
 
-  _fifo = new boost::circular_buffer<gr_complex>(5000000);
-  if (!_fifo) {
-    throw std::runtime_error( std::string(__FUNCTION__) + " " +
-                              "Failed to allocate a sample FIFO!" );
+  if ( _int16 )
+  {
+    int ret = airspy_set_sample_type(_dev, AIRSPY_SAMPLE_INT16_IQ);
+    AIRSPY_THROW_ON_ERROR(ret, "Failed to set 16 bit sample type")
   }
 }
 
@@ -191,7 +212,7 @@ airspy_source_c::~airspy_source_c ()
 
   if (_fifo)
   {
-    delete _fifo;
+    delete[] _fifo;
     _fifo = NULL;
   }
 }
@@ -200,34 +221,38 @@ int airspy_source_c::_airspy_rx_callback(airspy_transfer *transfer)
 {
   airspy_source_c *obj = (airspy_source_c *)transfer->ctx;
 
-  return obj->airspy_rx_callback((float *)transfer->samples, transfer->sample_count);
+  return obj->airspy_rx_callback(transfer->samples, transfer->sample_count);
 }
 
 int airspy_source_c::airspy_rx_callback(void *samples, int sample_count)
 {
-  size_t i, n_avail, to_copy, num_samples = sample_count;
-  float *sample = (float *)samples;
+  size_t n_avail, to_copy, num_samples = sample_count;
 
-  _fifo_lock.lock();
-
-  n_avail = _fifo->capacity() - _fifo->size();
+  n_avail = _fifo_ring.space();
   to_copy = (n_avail < num_samples ? n_avail : num_samples);
 
-  for (i = 0; i < to_copy; i++ )
-  {
-    /* Push sample to the fifo */
-    _fifo->push_back( gr_complex( *sample, *(sample+1) ) );
+  /* fill the FIFO in up to two segments around the wrap */
+  size_t tail = _fifo_ring.tail();
+  size_t first = std::min( to_copy, _fifo_ring.capacity() - tail );
 
-    /* offset to the next I+Q sample */
-    sample += 2;
-  }
+  if ( _int16 ) {
+    /* libairspy scales the 12 bit ADC data to the full 16 bit range */
+    const int16_t *sample = (const int16_t *)samples;
 
-  _fifo_lock.unlock();
+    convert_cs16_to_cf32( sample, _fifo + tail, first, 1.0f/32768.0f );
+    convert_cs16_to_cf32( sample + first * 2, _fifo, to_copy - first, 1.0f/32768.0f );
+  } else {
+    /* interleaved float I/Q has the layout of gr_complex */
+    const gr_complex *sample = (const gr_complex *)samples;
+
+    memcpy( _fifo + tail, sample, first * sizeof(gr_complex) );
+    memcpy( _fifo, sample + first, (to_copy - first) * sizeof(gr_complex) );
+  }
 
   /* We have made some new samples available to the consumer in work() */
   if (to_copy) {
     //std::cerr << "+" << std::flush;
-    _samp_avail.notify_one();
+    _fifo_ring.push( to_copy );
   }
 
   /* Indicate overrun, if neccesary */
@@ -242,6 +267,16 @@ bool airspy_source_c::start()
   if ( ! _dev )
     return false;
 
+  /* sized from the sample rate, allocated here so the callback never has to */
+  size_t capacity = std::max( size_t(_sample_rate * FIFO_DURATION), size_t(1 << 16) );
+
+  if ( ! _fifo || capacity != _fifo_ring.capacity() ) {
+    delete[] _fifo;
+    _fifo = new gr_complex[ capacity ];
+  }
+
+  _fifo_ring.reset( capacity );
+
   int ret = airspy_start_rx( _dev, _airspy_rx_callback, (void *)this );
   if ( ret != AIRSPY_SUCCESS ) {
     std::cerr << "Failed to start RX streaming (" << ret << ")" << std::endl;
@@ -257,6 +292,9 @@ bool airspy_source_c::stop()
     return false;
 
   int ret = airspy_stop_rx( _dev );
+
+  _fifo_ring.stop();
+
   if ( ret != AIRSPY_SUCCESS ) {
     std::cerr << "Failed to stop RX streaming (" << ret << ")" << std::endl;
     return false;
@@ -279,24 +317,23 @@ int airspy_source_c::work( int noutput_items,
   if ( ! running )
     return WORK_DONE;
 
-  boost::unique_lock<boost::mutex> lock(_fifo_lock);
-
   /* Wait until we have the requested number of samples */
-  int n_samples_avail = _fifo->size();
+  size_t n_samples = std::min( size_t(noutput_items), _fifo_ring.capacity() );
 
-  while (n_samples_avail < noutput_items) {
-    _samp_avail.wait(lock);
-    n_samples_avail = _fifo->size();
-  }
+  if ( ! _fifo_ring.wait( n_samples ) )
+    return WORK_DONE;
 
-  for(int i = 0; i < noutput_items; ++i) {
-    out[i] = _fifo->at(0);
-    _fifo->pop_front();
-  }
+  size_t head = _fifo_ring.head();
+  size_t first = std::min( n_samples, _fifo_ring.capacity() - head );
+
+  memcpy( out, _fifo + head, first * sizeof(gr_complex) );
+  memcpy( out + first, _fifo, (n_samples - first) * sizeof(gr_complex) );
+
+  _fifo_ring.pop( n_samples );
 
   //std::cerr << "-" << std::flush;
 
-  return noutput_items;
+  return n_samples;
 }
 
 std::vector<std::string> airspy_source_c::get_devices()
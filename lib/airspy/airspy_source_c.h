@@ -22,15 +22,12 @@
 #ifndef INCLUDED_AIRSPY_SOURCE_C_H
 #define INCLUDED_AIRSPY_SOURCE_C_H
 
-#include <boost/circular_buffer.hpp>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/condition_variable.hpp>
-
 #include <gnuradio/sync_block.h>
 
 #include <libairspy/airspy.h>
 
 #include "source_iface.h"
+#include "spsc_ring.h"
 
 class airspy_source_c;
 
@@ -126,10 +123,10 @@ private:
   int airspy_rx_callback(void *samples, int sample_count);
 
   airspy_device *_dev;
+  bool _int16;
 
-  boost::circular_buffer<gr_complex> *_fifo;
-  boost::mutex _fifo_lock;
-  boost::condition_variable _samp_avail;
+  gr_complex *_fifo;
+  spsc_ring _fifo_ring;
 
   std::vector< std::pair<double, uint32_t> > _sample_rates;
   double _sample_rate;
@@ -28,6 +28,7 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <string>
 #include <iomanip>
 #include <iostream>
@@ -39,10 +40,18 @@
 #include <boost/shared_ptr.hpp>
 
 #include "bladerf_common.h"
+#include "latency_helpers.h"
 
 #define NUM_BUFFERS 32
 #define NUM_SAMPLES_PER_BUFFER (4 * 1024)
 
+/* limits for the buffers derived in latency= and throughput= mode */
+#define PROFILE_BUFLEN_MIN (1 * 1024)
+#define PROFILE_BUFLEN_MAX (64 * 1024)
+#define PROFILE_BUFFERS_MIN 4
+#define PROFILE_LATENCY_BUFFERS 16
+#define PROFILE_THROUGHPUT_MS 10 /* per buffer */
+
 using namespace boost::assign;
 
 boost::mutex bladerf_common::_devs_mutex;
@@ -50,7 +59,11 @@ std::list<boost::weak_ptr<struct bladerf> > bladerf_common::_devs;
 
 bladerf_common::bladerf_common() :
   _conv_buf(NULL),
-  _conv_buf_size(4096),
+  _conv_buf_size(0),
+  _profile(PROFILE_NONE),
+  _latency_ms(0),
+  _streaming(false),
+  _reconfigure(false),
   _xb_200_attached(false),
   _consecutive_failures(0)
 {
@@ -192,6 +205,10 @@ bool bladerf_common::start(bladerf_module module)
   int ret;
   bladerf_format format;
 
+  _reconfigure = false;
+
+  set_stream_params(get_sample_rate(module));
+
   if (_use_metadata) {
       format = BLADERF_FORMAT_SC16_Q11_META;
   } else {
@@ -215,6 +232,8 @@ bool bladerf_common::start(bladerf_module module)
     return false;
   }
 
+  _streaming = true;
+
   return true;
 }
 
@@ -222,6 +241,8 @@ bool bladerf_common::stop(bladerf_module module)
 {
   int ret;
 
+  _streaming = false;
+
   ret = bladerf_enable_module(_dev.get(), module, false);
 
   if ( ret != 0 ) {
@@ -233,6 +254,101 @@ bool bladerf_common::stop(bladerf_module module)
   return true;
 }
 
+/*
+ * bladerf_sync_config() must not run while work() is inside
+ * bladerf_sync_rx/tx() on the scheduler thread, so set_sample_rate() only
+ * flags the change and work() restarts the stream before its next call.
+ */
+bool bladerf_common::reconfigure(bladerf_module module)
+{
+  _reconfigure = false;
+
+  if (!stop(module)) {
+    return false;
+  }
+
+  return start(module);
+}
+
+/*
+ * Derives the stream configuration from the sample rate. Values given
+ * through buffers=, buflen= and transfers= are always kept, the profile
+ * only fills in the others:
+ *
+ *  latency=ms   PROFILE_LATENCY_BUFFERS buffers which together hold about
+ *               ms worth of samples, fewer ones of the minimum length at
+ *               low rates.
+ *  throughput   NUM_BUFFERS buffers of PROFILE_THROUGHPUT_MS each, so
+ *               every USB transfer is as large as is useful.
+ *
+ * Without a profile the fixed defaults are used.
+ */
+void bladerf_common::set_stream_params(double rate)
+{
+  _num_buffers = _buffers_arg;
+  _samples_per_buffer = _buflen_arg;
+  _num_transfers = _transfers_arg;
+
+  if (_profile == PROFILE_LATENCY) {
+    size_t buffers = _num_buffers ? _num_buffers : PROFILE_LATENCY_BUFFERS;
+
+    if (0 == _samples_per_buffer) {
+      _samples_per_buffer = latency_to_buflen(rate, _latency_ms, buffers, 1, 1024,
+                                              PROFILE_BUFLEN_MIN, PROFILE_BUFLEN_MAX);
+    }
+
+    if (0 == _num_buffers) {
+      _num_buffers = latency_to_prefill(rate, _latency_ms, _samples_per_buffer, 1,
+                                        PROFILE_LATENCY_BUFFERS);
+      _num_buffers = std::max(_num_buffers, (size_t)PROFILE_BUFFERS_MIN);
+    }
+  } else if (_profile == PROFILE_THROUGHPUT) {
+    if (0 == _samples_per_buffer) {
+      _samples_per_buffer = latency_to_buflen(rate, PROFILE_THROUGHPUT_MS, 1, 1, 1024,
+                                              PROFILE_BUFLEN_MIN, PROFILE_BUFLEN_MAX);
+    }
+  }
+
+  /* Require value to be >= 2 so we can ensure we have twice as many
+   * buffers as transfers */
+  if (_num_buffers <= 1) {
+    _num_buffers = NUM_BUFFERS;
+  }
+
+  if (0 == _samples_per_buffer) {
+    _samples_per_buffer = NUM_SAMPLES_PER_BUFFER;
+  }
+
+  /* If the user hasn't specified the desired number of transfers, set it to
+   * min(32, num_buffers / 2) */
+  if (_num_transfers == 0) {
+      _num_transfers = _num_buffers / 2;
+      if (_num_transfers > 32) {
+          _num_transfers = 32;
+      }
+  } else if (_num_transfers >= _num_buffers) {
+      _num_transfers = _num_buffers - 1;
+      std::cerr << _pfx << "Clamping num_tranfers to " << _num_transfers << ". "
+                << "Try using a smaller num_transfers value if timeouts occur."
+                << std::endl;
+  }
+
+  if (_profile != PROFILE_NONE && rate > 0) {
+    std::cerr << _pfx << "Using " << _num_buffers << " buffers of "
+              << _samples_per_buffer << " samples, " << _num_transfers
+              << " transfers (" << get_latency(rate) * 1e3 << " ms)" << std::endl;
+  }
+}
+
+double bladerf_common::get_latency(double rate)
+{
+  if (rate <= 0) {
+    return 0;
+  }
+
+  return _num_buffers * _samples_per_buffer / rate;
+}
+
 static bool version_greater_or_equal(const struct bladerf_version *version,
                                     unsigned int major, unsigned int minor,
                                     unsigned int patch)
@@ -447,48 +563,46 @@ void bladerf_common::init(dict_t &dict, bladerf_module module)
 
   _use_metadata = dict.count("enable_metadata") != 0;
 
-  /* Require value to be >= 2 so we can ensure we have twice as many
-   * buffers as transfers */
-  if (_num_buffers <= 1) {
-    _num_buffers = NUM_BUFFERS;
+  if (dict.count("latency")) {
+    _profile = PROFILE_LATENCY;
+    _latency_ms = boost::lexical_cast< double >( dict["latency"] );
+  } else if (dict.count("throughput")) {
+    _profile = PROFILE_THROUGHPUT;
   }
 
-  if (0 == _samples_per_buffer) {
-    _samples_per_buffer = NUM_SAMPLES_PER_BUFFER;
-  } else {
-    if (_samples_per_buffer < 1024 || _samples_per_buffer % 1024 != 0) {
+  if (_samples_per_buffer != 0 &&
+      (_samples_per_buffer < 1024 || _samples_per_buffer % 1024 != 0)) {
+    std::cerr << _pfx << "Invalid \"buflen\" value. "
+              << "A multiple of 1024 is required. Defaulting to "
+              << NUM_SAMPLES_PER_BUFFER << std::endl;
 
-      /* 0 likely implies the user did not specify this, so don't warn */
-      if (_samples_per_buffer != 0 ) {
-        std::cerr << _pfx << "Invalid \"buflen\" value. "
-                  << "A multiple of 1024 is required. Defaulting to "
-                  << NUM_SAMPLES_PER_BUFFER << std::endl;
-      }
-
-      _samples_per_buffer = NUM_SAMPLES_PER_BUFFER;
-    }
+    _samples_per_buffer = 0;
   }
 
-  /* If the user hasn't specified the desired number of transfers, set it to
-   * min(32, num_buffers / 2) */
-  if (_num_transfers == 0) {
-      _num_transfers = _num_buffers / 2;
-      if (_num_transfers > 32) {
-          _num_transfers = 32;
-      }
-  } else if (_num_transfers >= _num_buffers) {
-      _num_transfers = _num_buffers - 1;
-      std::cerr << _pfx << "Clamping num_tranfers to " << _num_transfers << ". "
-                << "Try using a smaller num_transfers value if timeouts occur."
-                << std::endl;
+  /* 0 means derive, see set_stream_params() */
+  _buffers_arg = _num_buffers;
+  _buflen_arg = _samples_per_buffer;
+  _transfers_arg = _num_transfers;
+
+  set_stream_params(0);
+}
+
+bool bladerf_common::alloc_conv_buf(size_t nsamples)
+{
+  if (_conv_buf != NULL && nsamples == (size_t)_conv_buf_size) {
+    return true;
   }
 
-  _conv_buf = static_cast<int16_t*>(malloc(_conv_buf_size * 2 * sizeof(int16_t)));
+  free(_conv_buf);
+  _conv_buf = static_cast<int16_t*>(malloc(nsamples * 2 * sizeof(int16_t)));
+  _conv_buf_size = _conv_buf ? nsamples : 0;
 
   if (_conv_buf == NULL) {
-    throw std::runtime_error( std::string(__FUNCTION__) +
-                              "Failed to allocate _conv_buf" );
+    std::cerr << _pfx << "Failed to allocate _conv_buf" << std::endl;
+    return false;
   }
+
+  return true;
 }
 
 osmosdr::freq_range_t bladerf_common::freq_range()
@@ -564,6 +678,7 @@ double bladerf_common::set_sample_rate( bladerf_module module, double rate )
 {
   int status;
   struct bladerf_rational_rate rational_rate, actual;
+  double actual_rate;
 
   rational_rate.integer = (uint32_t)rate;
   rational_rate.den = 10000;
@@ -578,7 +693,14 @@ double bladerf_common::set_sample_rate( bladerf_module module, double rate )
                               std::string(bladerf_strerror(status)));
   }
 
-  return actual.integer + actual.num / (double)actual.den;
+  actual_rate = actual.integer + actual.num / (double)actual.den;
+
+  /* the stream is set up for the old rate, work() reconfigures it */
+  if (_profile != PROFILE_NONE && _streaming) {
+    _reconfigure = true;
+  }
+
+  return actual_rate;
 }
 
 double bladerf_common::get_sample_rate( bladerf_module module )
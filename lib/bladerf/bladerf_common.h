@@ -32,6 +32,7 @@
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/weak_ptr.hpp>
+#include <boost/atomic.hpp>
 
 #include <gnuradio/thread/thread.h>
 #include <gnuradio/gr_complex.h>
@@ -61,6 +62,17 @@ protected:
   bool start(bladerf_module module);
   bool stop(bladerf_module module);
 
+  /* applies a pending rate change to the stream, only called from work() */
+  bool reconfigure(bladerf_module module);
+
+  /* derives buffers, buflen and transfers for the given rate */
+  void set_stream_params(double rate);
+  /* seconds of samples the configured stream buffers hold */
+  double get_latency(double rate);
+
+  /* (re)sizes _conv_buf, to be called while not streaming */
+  bool alloc_conv_buf(size_t nsamples);
+
   double set_sample_rate(bladerf_module module, double rate);
   double get_sample_rate(bladerf_module module);
 
@@ -90,8 +102,23 @@ protected:
   int16_t *_conv_buf;
   int _conv_buf_size; /* In units of samples */
 
+  /* lower bound for _conv_buf if the block has no max_noutput_items */
+  static const int CONV_BUF_MIN = 16 * 1024;
+
   bool _use_metadata;
 
+  enum stream_profile { PROFILE_NONE, PROFILE_LATENCY, PROFILE_THROUGHPUT };
+
+  stream_profile _profile;
+  double _latency_ms;
+  bool _streaming;
+  boost::atomic<bool> _reconfigure; /* the stream is set up for an old rate */
+
+  /* as given by the device arguments, 0 if not set */
+  size_t _buffers_arg;
+  size_t _buflen_arg;
+  size_t _transfers_arg;
+
   osmosdr::gain_range_t _vga1_range;
   osmosdr::gain_range_t _vga2_range;
 
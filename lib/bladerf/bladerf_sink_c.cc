@@ -29,6 +29,7 @@
 #endif
 
 #include <iostream>
+#include <algorithm>
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
@@ -39,6 +40,7 @@
 #include <gnuradio/sync_block.h>
 
 #include "arg_helpers.h"
+#include "convert.h"
 #include "bladerf_sink_c.h"
 
 //#define DEBUG_BLADERF_SINK
@@ -96,6 +98,17 @@ bladerf_sink_c::bladerf_sink_c (const std::string &args)
 
 bool bladerf_sink_c::start()
 {
+  /* sized once here, work() never has to grow it */
+  size_t len = std::max(_samples_per_buffer, (size_t)CONV_BUF_MIN);
+
+  if (is_set_max_noutput_items()) {
+    len = std::max(len, (size_t)max_noutput_items());
+  }
+
+  if (!alloc_conv_buf(len)) {
+    return false;
+  }
+
   _in_burst = false;
   return bladerf_common::start(BLADERF_MODULE_TX);
 }
@@ -243,26 +256,17 @@ int bladerf_sink_c::work( int noutput_items,
   const float scaling = 2000.0f;
   int ret;
 
-  if (noutput_items > _conv_buf_size) {
-    void *tmp;
-
-    _conv_buf_size = noutput_items;
-    tmp = realloc(_conv_buf, _conv_buf_size * 2 * sizeof(int16_t));
-    if (tmp == NULL) {
-      throw std::runtime_error( std::string(__FUNCTION__) +
-                                "Failed to realloc _conv_buf" );
-    } else {
-      DBG("Resized _conv_buf to " << _conv_buf_size << " samples");
-    }
+  if (_reconfigure && !reconfigure(BLADERF_MODULE_TX)) {
+    return WORK_DONE;
+  }
 
-    _conv_buf = static_cast<int16_t*>(tmp);
+  /* the rest is handed to us again in the next call */
+  if (noutput_items > _conv_buf_size) {
+    noutput_items = _conv_buf_size;
   }
 
   /* Convert floating point samples into fixed point */
-  for (int i = 0; i < 2 * noutput_items;) {
-    _conv_buf[i++] = (int16_t)(scaling * real(*in));
-    _conv_buf[i++] = (int16_t)(scaling * imag(*in++));
-  }
+  convert_cf32_to_sc16q11(in, _conv_buf, noutput_items, scaling);
 
   if (_use_metadata) {
     ret = transmit_with_tags(noutput_items);
@@ -317,6 +321,11 @@ double bladerf_sink_c::get_sample_rate()
   return bladerf_common::get_sample_rate(BLADERF_MODULE_TX);
 }
 
+double bladerf_sink_c::get_latency( size_t mboard )
+{
+  return bladerf_common::get_latency( get_sample_rate() );
+}
+
 osmosdr::freq_range_t bladerf_sink_c::get_freq_range( size_t chan )
 {
   return freq_range();
@@ -89,6 +89,9 @@ public:
   double set_sample_rate( double rate );
   double get_sample_rate( void );
 
+  /* seconds of samples buffered by the stream at the current rate */
+  double get_latency( size_t mboard = 0 );
+
   osmosdr::freq_range_t get_freq_range( size_t chan = 0 );
   double set_center_freq( double freq, size_t chan = 0 );
   double get_center_freq( size_t chan = 0 );
@@ -29,19 +29,31 @@
 #endif
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include <gnuradio/io_signature.h>
+#ifndef ENABLE_RUNTIME
+#include <gnuradio/tags.h>
+#include <pmt/pmt.h>
+#endif
 
 #include "arg_helpers.h"
+#include "convert.h"
 #include "bladerf_source_c.h"
 #include "osmosdr/source.h"
 
 using namespace boost::assign;
 
+#ifndef ENABLE_RUNTIME
+static const pmt::pmt_t TIME_KEY = pmt::string_to_symbol("rx_time");
+static const pmt::pmt_t DROPPED_KEY = pmt::string_to_symbol("rx_dropped");
+#endif
+
 /*
  * Create a new instance of bladerf_source_c and return
  * a boost shared_ptr.  This is effectively the public constructor.
@@ -71,7 +83,13 @@ static const int MAX_OUT = 1;	// maximum number of output streams
 bladerf_source_c::bladerf_source_c (const std::string &args)
   : gr::sync_block ("bladerf_source_c",
                     gr::io_signature::make (MIN_IN, MAX_IN, sizeof (gr_complex)),
-                    gr::io_signature::make (MIN_OUT, MAX_OUT, sizeof (gr_complex)))
+                    gr::io_signature::make (MIN_OUT, MAX_OUT, sizeof (gr_complex))),
+    _next_timestamp(0),
+    _rate(0),
+    _stamp_valid(false),
+    _stamp_item(0),
+    _stamp_timestamp(0),
+    _stamp_dropped(0)
 {
   int ret;
   std::string device_name;
@@ -126,6 +144,9 @@ bladerf_source_c::bladerf_source_c (const std::string &args)
 
 bool bladerf_source_c::start()
 {
+  _rate = get_sample_rate();
+  _next_timestamp = 0;
+
   return bladerf_common::start(BLADERF_MODULE_RX);
 }
 
@@ -139,33 +160,31 @@ int bladerf_source_c::work( int noutput_items,
                             gr_vector_void_star &output_items )
 {
   int ret;
-  int16_t *current;
-  const float scaling = 1.0f / 2048.0f;
+  int count = noutput_items;
   gr_complex *out = static_cast<gr_complex *>(output_items[0]);
   struct bladerf_metadata meta;
   struct bladerf_metadata *meta_ptr = NULL;
 
-  if (noutput_items > _conv_buf_size) {
-    void *tmp;
-
-    _conv_buf_size = noutput_items;
-    tmp = realloc(_conv_buf, _conv_buf_size * 2 * sizeof(int16_t));
-    if (tmp == NULL) {
-      throw std::runtime_error( std::string(__FUNCTION__) +
-                                "Failed to realloc _conv_buf" );
-    }
-
-    _conv_buf = static_cast<int16_t*>(tmp);
+  if (_reconfigure && !reconfigure(BLADERF_MODULE_RX)) {
+    return WORK_DONE;
   }
 
+  /*
+   * The SC16 Q11 samples take half the space of their gr_complex
+   * counterparts, so they are received into the upper half of the output
+   * buffer and widened in place. The conversion runs front to back and
+   * never overwrites input it has not read yet.
+   */
+  int16_t *raw = reinterpret_cast<int16_t *>(out) + 2 * noutput_items;
+
   if (_use_metadata) {
     memset(&meta, 0, sizeof(meta));
     meta.flags = BLADERF_META_FLAG_RX_NOW;
     meta_ptr = &meta;
   }
 
-  /* Grab all the samples into the temporary buffer */
-  ret = bladerf_sync_rx(_dev.get(), static_cast<void *>(_conv_buf),
+  /* Grab all the samples into the output buffer */
+  ret = bladerf_sync_rx(_dev.get(), static_cast<void *>(raw),
                         noutput_items, meta_ptr, _stream_timeout_ms);
   if ( ret != 0 ) {
     std::cerr << _pfx << "bladerf_sync_rx error: "
@@ -181,24 +200,78 @@ int bladerf_source_c::work( int noutput_items,
     }
   } else {
       _consecutive_failures = 0;
-  }
 
-  current = _conv_buf;
+      if (_use_metadata) {
+        /* on an overrun libbladeRF returns early */
+        count = std::min(count, (int)meta.actual_count);
+        publish_timestamp(meta.timestamp, count);
+      }
+  }
 
   /* Convert them from fixed to floating point */
-  for (int i = 0; i < noutput_items; ++i) {
-    float x, y;
+  convert_sc16q11_to_cf32(raw, out, count);
+
+  return count;
+}
+
+/*
+ * The FPGA timestamp counts samples, so any gap to the value expected
+ * from the previous call is the number of samples lost in between.
+ */
+void bladerf_source_c::publish_timestamp( uint64_t timestamp, unsigned int count )
+{
+  uint64_t dropped = 0;
+
+  if ( _next_timestamp && timestamp > _next_timestamp )
+    dropped = timestamp - _next_timestamp;
+
+  _next_timestamp = timestamp + count;
 
-    x = scaling * *current;
-    current++;
+  {
+    boost::mutex::scoped_lock lock( _stamp_mutex );
 
-    y = scaling * *current;
-    current++;
+    _stamp_valid = true;
+    _stamp_item = nitems_written(0);
+    _stamp_timestamp = timestamp;
+    _stamp_dropped += dropped;
+  }
 
-    out[i] = gr_complex(x, y) ;
+  if ( dropped ) {
+    std::cerr << _pfx << "Dropped " << dropped << " samples" << std::endl;
   }
 
-  return noutput_items;
+#ifndef ENABLE_RUNTIME
+  double rate = _rate;
+
+  if ( rate > 0 ) {
+    /* in one domain, the rate may be rational (1e6/3) */
+    double t = timestamp / rate;
+    double whole = std::floor( t );
+    uint64_t secs = (uint64_t)whole;
+    double frac = t - whole;
+    const pmt::pmt_t val = pmt::make_tuple( pmt::from_uint64(secs),
+                                            pmt::from_double(frac) );
+
+    add_item_tag( 0, nitems_written(0), TIME_KEY, val, alias_pmt() );
+  }
+
+  if ( dropped ) {
+    add_item_tag( 0, nitems_written(0), DROPPED_KEY,
+                  pmt::from_uint64(dropped), alias_pmt() );
+  }
+#endif
+}
+
+bool bladerf_source_c::get_rx_timestamp( uint64_t &item, uint64_t &timestamp, uint64_t &dropped,
+                                         size_t mboard )
+{
+  boost::mutex::scoped_lock lock( _stamp_mutex );
+
+  item = _stamp_item;
+  timestamp = _stamp_timestamp;
+  dropped = _stamp_dropped;
+
+  return _stamp_valid;
 }
 
 std::vector<std::string> bladerf_source_c::get_devices()
@@ -219,7 +292,12 @@ osmosdr::meta_range_t bladerf_source_c::get_sample_rates()
 
 double bladerf_source_c::set_sample_rate( double rate )
 {
-  return bladerf_common::set_sample_rate( BLADERF_MODULE_RX, rate);
+  _rate = bladerf_common::set_sample_rate( BLADERF_MODULE_RX, rate);
+
+  /* timestamps taken at the old rate do not continue */
+  _next_timestamp = 0;
+
+  return _rate;
 }
 
 double bladerf_source_c::get_sample_rate()
@@ -227,6 +305,11 @@ double bladerf_source_c::get_sample_rate()
   return bladerf_common::get_sample_rate( BLADERF_MODULE_RX );
 }
 
+double bladerf_source_c::get_latency( size_t mboard )
+{
+  return bladerf_common::get_latency( get_sample_rate() );
+}
+
 osmosdr::freq_range_t bladerf_source_c::get_freq_range( size_t chan )
 {
   return freq_range();
@@ -81,6 +81,9 @@ public:
   double set_sample_rate( double rate );
   double get_sample_rate( void );
 
+  /* seconds of samples buffered by the stream at the current rate */
+  double get_latency( size_t mboard = 0 );
+
   osmosdr::freq_range_t get_freq_range( size_t chan = 0 );
   double set_center_freq( double freq, size_t chan = 0 );
   double get_center_freq( size_t chan = 0 );
@@ -117,8 +120,30 @@ public:
   std::string get_clock_source(const size_t mboard);
   std::vector<std::string> get_clock_sources(const size_t mboard);
 
+  /*!
+   * With enable_metadata, returns the hardware timestamp of the first
+   * sample of the latest work() call and that sample's absolute index in
+   * the output stream. Samples lost to overruns so far are counted in
+   * dropped. Returns false until the first timestamped call. The full
+   * GNU Radio runtime additionally gets these as rx_time tags.
+   */
+  bool get_rx_timestamp( uint64_t &item, uint64_t &timestamp, uint64_t &dropped,
+                         size_t mboard = 0 );
+
 private:
+  void publish_timestamp( uint64_t timestamp, unsigned int count );
+
   osmosdr::gain_range_t _lna_range;
+
+  /* timestamp expected for the next sample, 0 before the first call */
+  uint64_t _next_timestamp;
+  double _rate;
+
+  boost::mutex _stamp_mutex;
+  bool _stamp_valid;
+  uint64_t _stamp_item;
+  uint64_t _stamp_timestamp;
+  uint64_t _stamp_dropped;
 };
 
 #endif /* INCLUDED_BLADERF_SOURCE_C_H */
@@ -0,0 +1,356 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__) && defined(__arm__)
+#include <sys/auxv.h>
+#endif
+
+#include "convert_impl.h"
+
+/*
+ * Generic kernels, also used for the tails of the vector loops.
+ */
+
+static inline float clampf( float x, float lo, float hi )
+{
+  return x < lo ? lo : (x > hi ? hi : x);
+}
+
+/*
+ * On targets without a vector unit (ARMv6, MIPS, ...) whole buffers are
+ * converted through a byte indexed table. It only holds 256 floats on the
+ * stack, which stays in L1 unlike the 64K entry complex tables the drivers
+ * used to allocate. Where the compiler can vectorize the arithmetic loop
+ * below, that is faster than the table gather and the table is left out.
+ */
+#if !defined(__SSE2__) && !defined(_M_X64) && !(defined(_M_IX86_FP) && _M_IX86_FP >= 2) && \
+    !defined(__ARM_NEON) && !defined(__ARM_NEON__) && !defined(__ALTIVEC__)
+#define CONVERT_U8_LUT
+#define U8_LUT_MIN_SCALARS 1024
+#endif
+
+void convert_generic_u8_to_f32(const uint8_t *in, float *out, size_t n, float offset, float scale)
+{
+#ifdef CONVERT_U8_LUT
+  if (n >= U8_LUT_MIN_SCALARS) {
+    float lut[256];
+
+    for (size_t i = 0; i < 256; i++)
+      lut[i] = (float(i) - offset) * scale;
+
+    for (size_t i = 0; i < n; i++)
+      out[i] = lut[in[i]];
+
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < n; i++)
+    out[i] = (float(in[i]) - offset) * scale;
+}
+
+void convert_generic_s8_to_f32(const int8_t *in, float *out, size_t n, float scale)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = float(in[i]) * scale;
+}
+
+void convert_generic_s16_to_f32(const int16_t *in, float *out, size_t n, float scale)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = float(in[i]) * scale;
+}
+
+void convert_generic_f32_to_u8(const float *in, uint8_t *out, size_t n, float offset, float scale)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = (uint8_t)lrintf( clampf(in[i] * scale + offset, 0.0f, 255.0f) );
+}
+
+void convert_generic_f32_to_s8(const float *in, int8_t *out, size_t n, float scale)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = (int8_t)lrintf( clampf(in[i] * scale, -128.0f, 127.0f) );
+}
+
+void convert_generic_f32_to_s16(const float *in, int16_t *out, size_t n, float scale, float peak)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = (int16_t)lrintf( clampf(in[i] * scale, -peak, peak) );
+}
+
+void convert_generic_s16_planar_to_f32(const int16_t *in_i, const int16_t *in_q, float *out, size_t n, float scale)
+{
+  for (size_t i = 0; i < n; i++) {
+    *out++ = float(in_i[i]) * scale;
+    *out++ = float(in_q[i]) * scale;
+  }
+}
+
+/*
+ * Packed 12 bit I/Q, as used by SoapySDR's CS12:
+ *   byte 0: I[7:0]   byte 1: Q[3:0] I[11:8]   byte 2: Q[11:4]
+ */
+void convert_generic_cs12_to_f32(const uint8_t *in, float *out, size_t n, float scale)
+{
+  for (size_t i = 0; i < n; i++) {
+    int16_t re = int16_t(uint16_t(in[1] << 12) | uint16_t(in[0] << 4)) >> 4;
+    int16_t im = int16_t(uint16_t(in[2] << 8) | uint16_t(in[1] & 0xf0)) >> 4;
+
+    *out++ = float(re) * scale;
+    *out++ = float(im) * scale;
+    in += 3;
+  }
+}
+
+void convert_generic_f32_to_cs12(const float *in, uint8_t *out, size_t n, float scale)
+{
+  for (size_t i = 0; i < n; i++) {
+    uint16_t re = uint16_t(lrintf( clampf(*in++ * scale, -2048.0f, 2047.0f) ));
+    uint16_t im = uint16_t(lrintf( clampf(*in++ * scale, -2048.0f, 2047.0f) ));
+
+    *out++ = uint8_t(re);
+    *out++ = uint8_t(((re >> 8) & 0x0f) | (im << 4));
+    *out++ = uint8_t(im >> 4);
+  }
+}
+
+void convert_generic_s24_to_f32(const uint8_t *in, float *out, size_t n, float scale)
+{
+  for (size_t i = 0; i < n; i++) {
+    int32_t x = int32_t(uint32_t(in[0]) << 8 | uint32_t(in[1]) << 16 | uint32_t(in[2]) << 24) >> 8;
+
+    out[i] = float(x) * scale;
+    in += 3;
+  }
+}
+
+void convert_generic_u4_lut_to_f32(const uint8_t *in, float *out, size_t n, const int8_t *table, float scale)
+{
+  for (size_t i = 0; i < n; i++) {
+    *out++ = float(table[in[i] >> 4]) * scale;
+    *out++ = float(table[in[i] & 0x0f]) * scale;
+  }
+}
+
+void convert_init_generic(convert_kernels_t *k)
+{
+  k->name = "generic";
+  k->u8_to_f32 = convert_generic_u8_to_f32;
+  k->s8_to_f32 = convert_generic_s8_to_f32;
+  k->s16_to_f32 = convert_generic_s16_to_f32;
+  k->f32_to_u8 = convert_generic_f32_to_u8;
+  k->f32_to_s8 = convert_generic_f32_to_s8;
+  k->f32_to_s16 = convert_generic_f32_to_s16;
+  k->s16_planar_to_f32 = convert_generic_s16_planar_to_f32;
+  k->cs12_to_f32 = convert_generic_cs12_to_f32;
+  k->f32_to_cs12 = convert_generic_f32_to_cs12;
+  k->s24_to_f32 = convert_generic_s24_to_f32;
+  k->u4_lut_to_f32 = convert_generic_u4_lut_to_f32;
+}
+
+/*
+ * Runtime dispatch
+ */
+
+enum cpu_feature_t
+{
+  CPU_NONE = 0,
+  CPU_SSE2,
+  CPU_AVX2,
+  CPU_AVX512,
+  CPU_NEON
+};
+
+typedef struct
+{
+  const char *name;
+  void (*init)(convert_kernels_t *k);
+  cpu_feature_t feature;
+} convert_level_t;
+
+/* ordered from the least to the most capable */
+static const convert_level_t _levels[] =
+{
+  { "generic", convert_init_generic, CPU_NONE },
+#ifdef HAVE_CONVERT_SSE2
+  { "sse2", convert_init_sse2, CPU_SSE2 },
+#endif
+#ifdef HAVE_CONVERT_AVX2
+  { "avx2", convert_init_avx2, CPU_AVX2 },
+#endif
+#ifdef HAVE_CONVERT_AVX512
+  { "avx512", convert_init_avx512, CPU_AVX512 },
+#endif
+#ifdef HAVE_CONVERT_NEON
+  { "neon", convert_init_neon, CPU_NEON },
+#endif
+};
+
+static const size_t _num_levels = sizeof(_levels) / sizeof(_levels[0]);
+
+static bool cpu_supports( cpu_feature_t feature )
+{
+  if ( CPU_NONE == feature )
+    return true;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+
+  switch ( feature ) {
+  case CPU_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case CPU_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case CPU_AVX512:
+    return __builtin_cpu_supports("avx512f");
+  default:
+    break;
+  }
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  int info[4];
+
+  __cpuid(info, 0);
+  int max_leaf = info[0];
+
+  __cpuid(info, 1);
+  bool sse2 = (info[3] & (1 << 26)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+
+  /* the OS has to save the upper register halves on context switch */
+  unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+  bool ymm = (xcr0 & 0x06) == 0x06;
+  bool zmm = (xcr0 & 0xe6) == 0xe6;
+
+  int ebx7 = 0;
+  if ( max_leaf >= 7 ) {
+    __cpuidex(info, 7, 0);
+    ebx7 = info[1];
+  }
+
+  switch ( feature ) {
+  case CPU_SSE2:
+    return sse2;
+  case CPU_AVX2:
+    return ymm && (ebx7 & (1 << 5));
+  case CPU_AVX512:
+    return zmm && (ebx7 & (1 << 16));
+  default:
+    break;
+  }
+#elif defined(__aarch64__)
+  /* Advanced SIMD is mandatory on ARMv8-A */
+  if ( CPU_NEON == feature )
+    return true;
+#elif defined(__linux__) && defined(__arm__)
+  /* HWCAP_NEON from <asm/hwcap.h> */
+  if ( CPU_NEON == feature )
+    return (getauxval(AT_HWCAP) & (1 << 12)) != 0;
+#endif
+
+  return false;
+}
+
+/* apply all levels up to the given one, returns false if unsupported */
+static bool build_kernels( convert_kernels_t *k, size_t level )
+{
+  if ( level >= _num_levels )
+    return false;
+
+  for ( size_t i = 0; i <= level; i++ )
+    if ( ! cpu_supports( _levels[i].feature ) )
+      return false;
+
+  for ( size_t i = 0; i <= level; i++ )
+    _levels[i].init( k );
+
+  k->name = _levels[level].name;
+
+  return true;
+}
+
+static convert_kernels_t *select_kernels()
+{
+  static convert_kernels_t kernels;
+
+  for ( size_t level = _num_levels; level > 0; level-- )
+    if ( build_kernels( &kernels, level - 1 ) )
+      break;
+
+  return &kernels;
+}
+
+/* selected on first use, independent of static initialization order */
+static convert_kernels_t *instance()
+{
+  static convert_kernels_t *kernels = select_kernels();
+
+  return kernels;
+}
+
+const convert_kernels_t &convert_kernels()
+{
+  return *instance();
+}
+
+std::string convert_arch()
+{
+  return instance()->name;
+}
+
+bool convert_set_arch( const std::string &name )
+{
+  for ( size_t level = 0; level < _num_levels; level++ ) {
+    if ( name != _levels[level].name )
+      continue;
+
+    convert_kernels_t kernels;
+    if ( ! build_kernels( &kernels, level ) )
+      return false;
+
+    *instance() = kernels;
+    return true;
+  }
+
+  return false;
+}
+
+std::vector< std::string > convert_get_archs()
+{
+  std::vector< std::string > archs;
+  convert_kernels_t kernels;
+
+  for ( size_t level = 0; level < _num_levels; level++ )
+    if ( build_kernels( &kernels, level ) )
+      archs.push_back( _levels[level].name );
+
+  return archs;
+}
@@ -0,0 +1,199 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef OSMOSDR_CONVERT_H
+#define OSMOSDR_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <gnuradio/gr_complex.h>
+
+/*
+ * Sample format conversion shared by all hardware backends.
+ *
+ * Every function converts interleaved I/Q data, nsamples counts complex
+ * samples. The SIMD implementation (generic, SSE2, AVX2, AVX-512 or
+ * NEON) is chosen once at runtime from the capabilities of the host CPU,
+ * so a single binary runs on any x86 generation. Conversions towards integer
+ * formats round to nearest and saturate at the limits of the target type.
+ */
+
+typedef struct
+{
+  const char *name;
+
+  /*
+   * real valued kernels, n counts scalars (2 per complex sample). The
+   * widening ones work front to back, so they may run in place with the
+   * input occupying the upper end of the output buffer.
+   */
+  void (*u8_to_f32)(const uint8_t *in, float *out, size_t n, float offset, float scale);
+  void (*s8_to_f32)(const int8_t *in, float *out, size_t n, float scale);
+  void (*s16_to_f32)(const int16_t *in, float *out, size_t n, float scale);
+  void (*f32_to_u8)(const float *in, uint8_t *out, size_t n, float offset, float scale);
+  void (*f32_to_s8)(const float *in, int8_t *out, size_t n, float scale);
+  void (*f32_to_s16)(const float *in, int16_t *out, size_t n, float scale, float peak);
+
+  /* separate I and Q arrays to interleaved, n counts complex samples */
+  void (*s16_planar_to_f32)(const int16_t *in_i, const int16_t *in_q, float *out, size_t n, float scale);
+
+  /*
+   * packed 12 bit kernels, n counts complex samples (3 bytes each). The
+   * unpacking one also runs front to back and may work in place.
+   */
+  void (*cs12_to_f32)(const uint8_t *in, float *out, size_t n, float scale);
+  void (*f32_to_cs12)(const float *in, uint8_t *out, size_t n, float scale);
+
+  /* packed 24 bit little endian, n counts scalars (3 bytes each) */
+  void (*s24_to_f32)(const uint8_t *in, float *out, size_t n, float scale);
+
+  /*
+   * two 4 bit codes per byte, high nibble first, each looked up in a 16
+   * entry table. n counts bytes, so 2 * n scalars are written.
+   */
+  void (*u4_lut_to_f32)(const uint8_t *in, float *out, size_t n, const int8_t *table, float scale);
+} convert_kernels_t;
+
+/*!
+ * Returns the kernel table selected for the host CPU.
+ */
+const convert_kernels_t &convert_kernels();
+
+/*!
+ * Returns the name of the selected kernel table ("generic", "sse2", ...).
+ */
+std::string convert_arch();
+
+/*!
+ * Overrides the automatic selection, mostly useful for benchmarking.
+ * Returns false if the named implementation is not available on this host.
+ */
+bool convert_set_arch( const std::string &name );
+
+/*!
+ * Returns the names of all implementations usable on this host.
+ */
+std::vector< std::string > convert_get_archs();
+
+/* 8 bit unsigned I/Q (RTL2832U), out = (in - offset) * scale */
+inline void convert_cu8_to_cf32( const void *in, gr_complex *out, size_t nsamples,
+                                 float offset, float scale )
+{
+  convert_kernels().u8_to_f32( (const uint8_t *)in, (float *)out, nsamples * 2,
+                               offset, scale );
+}
+
+/* 8 bit signed I/Q (HackRF) */
+inline void convert_cs8_to_cf32( const void *in, gr_complex *out, size_t nsamples,
+                                 float scale )
+{
+  convert_kernels().s8_to_f32( (const int8_t *)in, (float *)out, nsamples * 2,
+                               scale );
+}
+
+/* 12 bit signed I/Q packed into 3 bytes per complex sample */
+inline void convert_cs12_to_cf32( const void *in, gr_complex *out, size_t nsamples,
+                                  float scale )
+{
+  convert_kernels().cs12_to_f32( (const uint8_t *)in, (float *)out, nsamples,
+                                 scale );
+}
+
+/* 16 bit signed I/Q */
+inline void convert_cs16_to_cf32( const void *in, gr_complex *out, size_t nsamples,
+                                  float scale )
+{
+  convert_kernels().s16_to_f32( (const int16_t *)in, (float *)out, nsamples * 2,
+                                scale );
+}
+
+/* 24 bit signed I/Q packed into 6 bytes per complex sample (NetSDR) */
+inline void convert_cs24_to_cf32( const void *in, gr_complex *out, size_t nsamples,
+                                  float scale )
+{
+  convert_kernels().s24_to_f32( (const uint8_t *)in, (float *)out, nsamples * 2,
+                                scale );
+}
+
+/* 4 bit companded I/Q, one byte per complex sample with I in the high nibble */
+inline void convert_cu4_to_cf32( const void *in, gr_complex *out, size_t nsamples,
+                                 const int8_t *table, float scale )
+{
+  convert_kernels().u4_lut_to_f32( (const uint8_t *)in, (float *)out, nsamples,
+                                   table, scale );
+}
+
+/* 16 bit signed I and Q in separate arrays (SDRplay) */
+inline void convert_cs16_planar_to_cf32( const void *in_i, const void *in_q, gr_complex *out,
+                                         size_t nsamples, float scale )
+{
+  convert_kernels().s16_planar_to_f32( (const int16_t *)in_i, (const int16_t *)in_q,
+                                       (float *)out, nsamples, scale );
+}
+
+/* 12 bit signed I/Q in 16 bit words (bladeRF SC16 Q11) */
+inline void convert_sc16q11_to_cf32( const void *in, gr_complex *out, size_t nsamples )
+{
+  convert_cs16_to_cf32( in, out, nsamples, 1.0f / 2048.0f );
+}
+
+/* out = in * scale + offset */
+inline void convert_cf32_to_cu8( const gr_complex *in, void *out, size_t nsamples,
+                                 float offset, float scale )
+{
+  convert_kernels().f32_to_u8( (const float *)in, (uint8_t *)out, nsamples * 2,
+                               offset, scale );
+}
+
+inline void convert_cf32_to_cs8( const gr_complex *in, void *out, size_t nsamples,
+                                 float scale )
+{
+  convert_kernels().f32_to_s8( (const float *)in, (int8_t *)out, nsamples * 2,
+                               scale );
+}
+
+inline void convert_cf32_to_cs12( const gr_complex *in, void *out, size_t nsamples,
+                                  float scale )
+{
+  convert_kernels().f32_to_cs12( (const float *)in, (uint8_t *)out, nsamples,
+                                 scale );
+}
+
+/* peak limits the magnitude for devices with fewer significant bits */
+inline void convert_cf32_to_cs16( const gr_complex *in, void *out, size_t nsamples,
+                                  float scale, float peak = 32767.0f )
+{
+  convert_kernels().f32_to_s16( (const float *)in, (int16_t *)out, nsamples * 2,
+                                scale, peak );
+}
+
+/* saturates at +/- 2047 as required by the SC16 Q11 format */
+inline void convert_cf32_to_sc16q11( const gr_complex *in, void *out, size_t nsamples,
+                                     float scale = 2048.0f )
+{
+  convert_kernels().f32_to_s16( (const float *)in, (int16_t *)out, nsamples * 2,
+                                scale, 2047.0f );
+}
+
+#endif // OSMOSDR_CONVERT_H
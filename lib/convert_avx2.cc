@@ -0,0 +1,269 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <immintrin.h>
+
+#include "convert_impl.h"
+
+/* 32 unsigned bytes per iteration */
+static void u8_to_f32_avx2(const uint8_t *in, float *out, size_t n, float offset, float scale)
+{
+  const __m256 off = _mm256_set1_ps(offset);
+  const __m256 mul = _mm256_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    for (size_t j = 0; j < 32; j += 8) {
+      __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + i + j)));
+      _mm256_storeu_ps(out + i + j, _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(x), off), mul));
+    }
+  }
+
+  convert_generic_u8_to_f32(in + i, out + i, n - i, offset, scale);
+}
+
+/* 32 signed bytes per iteration */
+static void s8_to_f32_avx2(const int8_t *in, float *out, size_t n, float scale)
+{
+  const __m256 mul = _mm256_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    for (size_t j = 0; j < 32; j += 8) {
+      __m256i x = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(in + i + j)));
+      _mm256_storeu_ps(out + i + j, _mm256_mul_ps(_mm256_cvtepi32_ps(x), mul));
+    }
+  }
+
+  convert_generic_s8_to_f32(in + i, out + i, n - i, scale);
+}
+
+/* 32 shorts per iteration */
+static void s16_to_f32_avx2(const int16_t *in, float *out, size_t n, float scale)
+{
+  const __m256 mul = _mm256_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    for (size_t j = 0; j < 32; j += 8) {
+      __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i + j)));
+      _mm256_storeu_ps(out + i + j, _mm256_mul_ps(_mm256_cvtepi32_ps(x), mul));
+    }
+  }
+
+  convert_generic_s16_to_f32(in + i, out + i, n - i, scale);
+}
+
+/*
+ * 16 complex samples per iteration. The 256 bit unpacks work per 128 bit
+ * lane, so the low lanes hold samples 0-3 and 4-7, the high lanes 8-15.
+ */
+static void s16_planar_to_f32_avx2(const int16_t *in_i, const int16_t *in_q, float *out, size_t n, float scale)
+{
+  const __m256 mul = _mm256_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i re = _mm256_loadu_si256((const __m256i *)(in_i + i));
+    __m256i im = _mm256_loadu_si256((const __m256i *)(in_q + i));
+    __m256i lo = _mm256_unpacklo_epi16(re, im);
+    __m256i hi = _mm256_unpackhi_epi16(re, im);
+    float *o = out + i * 2;
+
+    _mm256_storeu_ps(o +  0, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(lo))), mul));
+    _mm256_storeu_ps(o +  8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(hi))), mul));
+    _mm256_storeu_ps(o + 16, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(lo, 1))), mul));
+    _mm256_storeu_ps(o + 24, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(hi, 1))), mul));
+  }
+
+  convert_generic_s16_planar_to_f32(in_i + i, in_q + i, out + i * 2, n - i, scale);
+}
+
+/* see convert_sse2.cc on why we clamp before the conversion */
+static inline __m256i f32_to_s32(const float *in, __m256 mul, __m256 off, __m256 lo, __m256 hi)
+{
+  __m256 x = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in), mul), off);
+  return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(x, lo), hi));
+}
+
+/* the 256 bit packs work per 128 bit lane, this restores sample order */
+static inline __m256i packs_epi32(__m256i a, __m256i b)
+{
+  return _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static void f32_to_u8_avx2(const float *in, uint8_t *out, size_t n, float offset, float scale)
+{
+  const __m256 off = _mm256_set1_ps(offset);
+  const __m256 mul = _mm256_set1_ps(scale);
+  const __m256 lo = _mm256_set1_ps(0.0f);
+  const __m256 hi = _mm256_set1_ps(255.0f);
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i ab = packs_epi32(f32_to_s32(in + i +  0, mul, off, lo, hi),
+                             f32_to_s32(in + i +  8, mul, off, lo, hi));
+    __m256i cd = packs_epi32(f32_to_s32(in + i + 16, mul, off, lo, hi),
+                             f32_to_s32(in + i + 24, mul, off, lo, hi));
+    __m256i x = _mm256_permute4x64_epi64(_mm256_packus_epi16(ab, cd), _MM_SHUFFLE(3, 1, 2, 0));
+
+    _mm256_storeu_si256((__m256i *)(out + i), x);
+  }
+
+  convert_generic_f32_to_u8(in + i, out + i, n - i, offset, scale);
+}
+
+static void f32_to_s8_avx2(const float *in, int8_t *out, size_t n, float scale)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 mul = _mm256_set1_ps(scale);
+  const __m256 lo = _mm256_set1_ps(-128.0f);
+  const __m256 hi = _mm256_set1_ps(127.0f);
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i ab = packs_epi32(f32_to_s32(in + i +  0, mul, zero, lo, hi),
+                             f32_to_s32(in + i +  8, mul, zero, lo, hi));
+    __m256i cd = packs_epi32(f32_to_s32(in + i + 16, mul, zero, lo, hi),
+                             f32_to_s32(in + i + 24, mul, zero, lo, hi));
+    __m256i x = _mm256_permute4x64_epi64(_mm256_packs_epi16(ab, cd), _MM_SHUFFLE(3, 1, 2, 0));
+
+    _mm256_storeu_si256((__m256i *)(out + i), x);
+  }
+
+  convert_generic_f32_to_s8(in + i, out + i, n - i, scale);
+}
+
+static void f32_to_s16_avx2(const float *in, int16_t *out, size_t n, float scale, float peak)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 mul = _mm256_set1_ps(scale);
+  const __m256 lo = _mm256_set1_ps(-peak);
+  const __m256 hi = _mm256_set1_ps(peak);
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i ab = packs_epi32(f32_to_s32(in + i +  0, mul, zero, lo, hi),
+                             f32_to_s32(in + i +  8, mul, zero, lo, hi));
+    __m256i cd = packs_epi32(f32_to_s32(in + i + 16, mul, zero, lo, hi),
+                             f32_to_s32(in + i + 24, mul, zero, lo, hi));
+
+    _mm256_storeu_si256((__m256i *)(out + i +  0), ab);
+    _mm256_storeu_si256((__m256i *)(out + i + 16), cd);
+  }
+
+  convert_generic_f32_to_s16(in + i, out + i, n - i, scale, peak);
+}
+
+/*
+ * Packed 12 bit I/Q, 4 complex samples (12 bytes) per 128 bit load. The
+ * shuffle moves bytes (b0,b1) into the I and (b1,b2) into the Q words,
+ * the shifts then drop the foreign nibble and sign extend.
+ */
+static void cs12_to_f32_avx2(const uint8_t *in, float *out, size_t n, float scale)
+{
+  const __m128i shuf = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+  const __m128i mask = _mm_setr_epi16(-1, 0, -1, 0, -1, 0, -1, 0);
+  const __m256 mul = _mm256_set1_ps(scale);
+  size_t i = 0;
+
+  /* the last load reads 4 bytes beyond the 12 we consume */
+  for (; i + 6 <= n; i += 4) {
+    __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i * 3)), shuf);
+    __m128i re = _mm_srai_epi16(_mm_slli_epi16(x, 4), 4);
+    __m128i im = _mm_srai_epi16(x, 4);
+    __m128i iq = _mm_or_si128(_mm_and_si128(mask, re), _mm_andnot_si128(mask, im));
+
+    _mm256_storeu_ps(out + i * 2, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(iq)), mul));
+  }
+
+  convert_generic_cs12_to_f32(in + i * 3, out + i * 2, n - i, scale);
+}
+
+/*
+ * Packed 24 bit, 8 scalars from two overlapping 128 bit loads. The shuffle
+ * puts every value into the upper three bytes of a 32 bit lane, the
+ * arithmetic shift then sign extends it.
+ */
+static void s24_to_f32_avx2(const uint8_t *in, float *out, size_t n, float scale)
+{
+  const __m256i shuf = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+  const __m256 mul = _mm256_set1_ps(scale);
+  size_t i = 0;
+
+  /* the upper load reads 4 bytes beyond the 24 we consume */
+  for (; i + 10 <= n; i += 8) {
+    const uint8_t *p = in + i * 3;
+    __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                        _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+
+    x = _mm256_srai_epi32(_mm256_shuffle_epi8(x, shuf), 8);
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), mul));
+  }
+
+  convert_generic_s24_to_f32(in + i * 3, out + i, n - i, scale);
+}
+
+/*
+ * 16 bytes (32 codes) per iteration. The nibbles are split and interleaved
+ * back into I/Q order, a 128 bit pshufb then does the table lookup.
+ */
+static void u4_lut_to_f32_avx2(const uint8_t *in, float *out, size_t n, const int8_t *table, float scale)
+{
+  const __m128i lut = _mm_loadu_si128((const __m128i *)table);
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m256 mul = _mm256_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+    __m128i lo = _mm_and_si128(x, mask);
+    __m128i a = _mm_shuffle_epi8(lut, _mm_unpacklo_epi8(hi, lo));
+    __m128i b = _mm_shuffle_epi8(lut, _mm_unpackhi_epi8(hi, lo));
+    float *o = out + i * 2;
+
+    _mm256_storeu_ps(o +  0, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(a)), mul));
+    _mm256_storeu_ps(o +  8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(a, 8))), mul));
+    _mm256_storeu_ps(o + 16, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b)), mul));
+    _mm256_storeu_ps(o + 24, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(b, 8))), mul));
+  }
+
+  convert_generic_u4_lut_to_f32(in + i, out + i * 2, n - i, table, scale);
+}
+
+void convert_init_avx2(convert_kernels_t *k)
+{
+  k->u8_to_f32 = u8_to_f32_avx2;
+  k->s8_to_f32 = s8_to_f32_avx2;
+  k->s16_to_f32 = s16_to_f32_avx2;
+  k->f32_to_u8 = f32_to_u8_avx2;
+  k->f32_to_s8 = f32_to_s8_avx2;
+  k->f32_to_s16 = f32_to_s16_avx2;
+  k->s16_planar_to_f32 = s16_planar_to_f32_avx2;
+  k->cs12_to_f32 = cs12_to_f32_avx2;
+  k->s24_to_f32 = s24_to_f32_avx2;
+  k->u4_lut_to_f32 = u4_lut_to_f32_avx2;
+}
@@ -0,0 +1,157 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <immintrin.h>
+
+#include "convert_impl.h"
+
+/* GCC 12 warns about the _mm512_undefined_*() idiom inside its own headers */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+/*
+ * Only AVX-512F instructions are used, the widening loads and the
+ * narrowing stores are available there for 32 bit elements.
+ */
+
+/* 64 unsigned bytes per iteration */
+static void u8_to_f32_avx512(const uint8_t *in, float *out, size_t n, float offset, float scale)
+{
+  const __m512 off = _mm512_set1_ps(offset);
+  const __m512 mul = _mm512_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 64 <= n; i += 64) {
+    for (size_t j = 0; j < 64; j += 16) {
+      __m512i x = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(in + i + j)));
+      _mm512_storeu_ps(out + i + j, _mm512_mul_ps(_mm512_sub_ps(_mm512_cvtepi32_ps(x), off), mul));
+    }
+  }
+
+  convert_generic_u8_to_f32(in + i, out + i, n - i, offset, scale);
+}
+
+/* 64 signed bytes per iteration */
+static void s8_to_f32_avx512(const int8_t *in, float *out, size_t n, float scale)
+{
+  const __m512 mul = _mm512_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 64 <= n; i += 64) {
+    for (size_t j = 0; j < 64; j += 16) {
+      __m512i x = _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)(in + i + j)));
+      _mm512_storeu_ps(out + i + j, _mm512_mul_ps(_mm512_cvtepi32_ps(x), mul));
+    }
+  }
+
+  convert_generic_s8_to_f32(in + i, out + i, n - i, scale);
+}
+
+/* 64 shorts per iteration */
+static void s16_to_f32_avx512(const int16_t *in, float *out, size_t n, float scale)
+{
+  const __m512 mul = _mm512_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 64 <= n; i += 64) {
+    for (size_t j = 0; j < 64; j += 16) {
+      __m512i x = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(in + i + j)));
+      _mm512_storeu_ps(out + i + j, _mm512_mul_ps(_mm512_cvtepi32_ps(x), mul));
+    }
+  }
+
+  convert_generic_s16_to_f32(in + i, out + i, n - i, scale);
+}
+
+/* see convert_sse2.cc on why we clamp before the conversion */
+static inline __m512i f32_to_s32(const float *in, __m512 mul, __m512 off, __m512 lo, __m512 hi)
+{
+  __m512 x = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(in), mul), off);
+  return _mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(x, lo), hi));
+}
+
+static void f32_to_u8_avx512(const float *in, uint8_t *out, size_t n, float offset, float scale)
+{
+  const __m512 off = _mm512_set1_ps(offset);
+  const __m512 mul = _mm512_set1_ps(scale);
+  const __m512 lo = _mm512_set1_ps(0.0f);
+  const __m512 hi = _mm512_set1_ps(255.0f);
+  size_t i = 0;
+
+  for (; i + 64 <= n; i += 64) {
+    for (size_t j = 0; j < 64; j += 16) {
+      __m512i x = f32_to_s32(in + i + j, mul, off, lo, hi);
+      _mm_storeu_si128((__m128i *)(out + i + j), _mm512_cvtepi32_epi8(x));
+    }
+  }
+
+  convert_generic_f32_to_u8(in + i, out + i, n - i, offset, scale);
+}
+
+static void f32_to_s8_avx512(const float *in, int8_t *out, size_t n, float scale)
+{
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 mul = _mm512_set1_ps(scale);
+  const __m512 lo = _mm512_set1_ps(-128.0f);
+  const __m512 hi = _mm512_set1_ps(127.0f);
+  size_t i = 0;
+
+  for (; i + 64 <= n; i += 64) {
+    for (size_t j = 0; j < 64; j += 16) {
+      __m512i x = f32_to_s32(in + i + j, mul, zero, lo, hi);
+      _mm_storeu_si128((__m128i *)(out + i + j), _mm512_cvtsepi32_epi8(x));
+    }
+  }
+
+  convert_generic_f32_to_s8(in + i, out + i, n - i, scale);
+}
+
+static void f32_to_s16_avx512(const float *in, int16_t *out, size_t n, float scale, float peak)
+{
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 mul = _mm512_set1_ps(scale);
+  const __m512 lo = _mm512_set1_ps(-peak);
+  const __m512 hi = _mm512_set1_ps(peak);
+  size_t i = 0;
+
+  for (; i + 64 <= n; i += 64) {
+    for (size_t j = 0; j < 64; j += 16) {
+      __m512i x = f32_to_s32(in + i + j, mul, zero, lo, hi);
+      _mm256_storeu_si256((__m256i *)(out + i + j), _mm512_cvtsepi32_epi16(x));
+    }
+  }
+
+  convert_generic_f32_to_s16(in + i, out + i, n - i, scale, peak);
+}
+
+void convert_init_avx512(convert_kernels_t *k)
+{
+  k->u8_to_f32 = u8_to_f32_avx512;
+  k->s8_to_f32 = s8_to_f32_avx512;
+  k->s16_to_f32 = s16_to_f32_avx512;
+  k->f32_to_u8 = f32_to_u8_avx512;
+  k->f32_to_s8 = f32_to_s8_avx512;
+  k->f32_to_s16 = f32_to_s16_avx512;
+}
@@ -0,0 +1,229 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * Throughput of the sample format conversions, for every implementation
+ * usable on this host. The 64K entry table the rtl drivers used before
+ * the shared kernels is measured as a reference for the cu8 case.
+ *
+ * usage: osmosdr_convert_bench [samples per call] [seconds per case]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "convert.h"
+
+typedef void (*bench_fn_t)( const void *in, void *out, size_t nsamples );
+
+typedef struct
+{
+  const char *name;
+  size_t in_size;   /* bytes per complex input sample */
+  size_t out_size;  /* bytes per complex output sample */
+  bench_fn_t fn;
+  bool tx;          /* takes cf32, fed with values slightly beyond +/-1 */
+} bench_case_t;
+
+static std::vector< gr_complex > _lut;
+
+static void cu8_lut( const void *in, void *out, size_t nsamples )
+{
+  const unsigned short *buf = (const unsigned short *)in;
+  gr_complex *o = (gr_complex *)out;
+
+  for ( size_t i = 0; i < nsamples; i++ )
+    *o++ = _lut[ *(buf + i) ];
+}
+
+static void cu8( const void *in, void *out, size_t nsamples )
+{
+  convert_cu8_to_cf32( in, (gr_complex *)out, nsamples, 127.4f, 1.0f/128.0f );
+}
+
+static void cs8( const void *in, void *out, size_t nsamples )
+{
+  convert_cs8_to_cf32( in, (gr_complex *)out, nsamples, 1.0f/128.0f );
+}
+
+static void cs16( const void *in, void *out, size_t nsamples )
+{
+  convert_cs16_to_cf32( in, (gr_complex *)out, nsamples, 1.0f/32768.0f );
+}
+
+static void cs24( const void *in, void *out, size_t nsamples )
+{
+  convert_cs24_to_cf32( in, (gr_complex *)out, nsamples, 1.0f/8388608.0f );
+}
+
+/* the companding table of the rtl_tcp cu4 wire format */
+static const int8_t _cu4_levels[16] =
+  { -105, -72, -48, -32, -20, -12, -6, -2, 2, 6, 12, 20, 32, 48, 72, 105 };
+
+static void cu4( const void *in, void *out, size_t nsamples )
+{
+  convert_cu4_to_cf32( in, (gr_complex *)out, nsamples, _cu4_levels, 1.0f/128.0f );
+}
+
+/* I in the first, Q in the second half of the input */
+static void cs16_planar( const void *in, void *out, size_t nsamples )
+{
+  convert_cs16_planar_to_cf32( in, (const int16_t *)in + nsamples, (gr_complex *)out,
+                               nsamples, 1.0f/32768.0f );
+}
+
+static void cf32_cs8( const void *in, void *out, size_t nsamples )
+{
+  convert_cf32_to_cs8( (const gr_complex *)in, out, nsamples, 127.0f );
+}
+
+static void cf32_cs16( const void *in, void *out, size_t nsamples )
+{
+  convert_cf32_to_cs16( (const gr_complex *)in, out, nsamples, 32767.0f );
+}
+
+static const bench_case_t _cases[] =
+{
+  { "cu8 -> cf32", 2, 8, cu8, false },
+  { "cs8 -> cf32", 2, 8, cs8, false },
+  { "cs16 -> cf32", 4, 8, cs16, false },
+  { "cs16 planar -> cf32", 4, 8, cs16_planar, false },
+  { "cs24 -> cf32", 6, 8, cs24, false },
+  { "cu4 -> cf32", 1, 8, cu4, false },
+  { "cf32 -> cs8", 8, 2, cf32_cs8, true },
+  { "cf32 -> cs16", 8, 4, cf32_cs16, true },
+};
+
+static double now()
+{
+  using namespace boost::posix_time;
+
+  static const ptime epoch = microsec_clock::universal_time();
+
+  return (microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+}
+
+/* returns samples per second */
+static double run( bench_fn_t fn, const void *in, void *out, size_t nsamples, double seconds )
+{
+  size_t calls = 0;
+
+  fn( in, out, nsamples ); /* warm up */
+
+  double start = now(), elapsed = 0;
+  do {
+    for ( int i = 0; i < 16; i++ )
+      fn( in, out, nsamples );
+    calls += 16;
+    elapsed = now() - start;
+  } while ( elapsed < seconds );
+
+  return calls * nsamples / elapsed;
+}
+
+static void report( const std::string &name, double rate, bool match )
+{
+  std::cout << "  " << std::left << std::setw(10) << name
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << rate / 1e6 << " Msps"
+            << (match ? "" : "  MISMATCH") << std::endl;
+}
+
+int main( int argc, char **argv )
+{
+  size_t nsamples = argc > 1 ? strtoul( argv[1], NULL, 0 ) : 16384;
+  double seconds = argc > 2 ? strtod( argv[2], NULL ) : 0.5;
+  int errors = 0;
+
+  if ( ! nsamples ) {
+    std::cerr << "usage: " << argv[0] << " [samples per call] [seconds per case]"
+              << std::endl;
+    return 1;
+  }
+
+  /* the table as it was built by rtl_source_c on little endian hosts */
+  for (unsigned int i = 0; i <= 0xffff; i++)
+    _lut.push_back( gr_complex( (float(i & 0xff) - 127.4f) * (1.0f/128.0f),
+                                (float(i >> 8) - 127.4f) * (1.0f/128.0f) ) );
+
+  std::vector< unsigned char > in( nsamples * 8 );
+  std::vector< float > tx_in( nsamples * 2 );
+  std::vector< unsigned char > out( nsamples * 8 );
+  std::vector< unsigned char > ref( nsamples * 8 );
+
+  srand( 1 );
+  for ( size_t i = 0; i < in.size(); i++ )
+    in[i] = rand() & 0xff;
+
+  /* up to +/- 1.25, so the saturation is exercised as well */
+  for ( size_t i = 0; i < tx_in.size(); i++ )
+    tx_in[i] = ( rand() % 2561 - 1280 ) / 1024.0f;
+
+  std::vector< std::string > archs = convert_get_archs();
+  std::string best = convert_arch();
+
+  std::cout << "samples per call: " << nsamples
+            << ", selected implementation: " << best << std::endl;
+
+  for ( size_t c = 0; c < sizeof(_cases) / sizeof(_cases[0]); c++ ) {
+    const bench_case_t &bc = _cases[c];
+    const void *src = bc.tx ? (const void *)&tx_in[0] : (const void *)&in[0];
+    size_t out_bytes = nsamples * bc.out_size;
+
+    std::cout << bc.name << std::endl;
+
+    convert_set_arch( "generic" );
+    bc.fn( src, &ref[0], nsamples );
+
+    if ( bc.fn == cu8 ) {
+      bool match = true;
+      cu8_lut( &in[0], &out[0], nsamples );
+      match = memcmp( &out[0], &ref[0], out_bytes ) == 0;
+      errors += ! match;
+      report( "lut64k", run( cu8_lut, &in[0], &out[0], nsamples, seconds ), match );
+    }
+
+    for ( size_t a = 0; a < archs.size(); a++ ) {
+      convert_set_arch( archs[a] );
+
+      memset( &out[0], 0, out_bytes );
+      bc.fn( src, &out[0], nsamples );
+      bool match = memcmp( &out[0], &ref[0], out_bytes ) == 0;
+      errors += ! match;
+
+      report( archs[a], run( bc.fn, src, &out[0], nsamples, seconds ), match );
+    }
+  }
+
+  convert_set_arch( best );
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef OSMOSDR_CONVERT_IMPL_H
+#define OSMOSDR_CONVERT_IMPL_H
+
+#include "convert.h"
+
+/*
+ * Internal interface between the dispatcher and the per instruction set
+ * translation units. Each convert_init_<isa>() overrides the entries of
+ * the table it has an implementation for, the rest is inherited from the
+ * previous (less capable) level. The vector loops hand their tail to the
+ * generic kernels, which define the reference rounding and saturation.
+ */
+
+void convert_generic_u8_to_f32(const uint8_t *in, float *out, size_t n, float offset, float scale);
+void convert_generic_s8_to_f32(const int8_t *in, float *out, size_t n, float scale);
+void convert_generic_s16_to_f32(const int16_t *in, float *out, size_t n, float scale);
+void convert_generic_f32_to_u8(const float *in, uint8_t *out, size_t n, float offset, float scale);
+void convert_generic_f32_to_s8(const float *in, int8_t *out, size_t n, float scale);
+void convert_generic_f32_to_s16(const float *in, int16_t *out, size_t n, float scale, float peak);
+void convert_generic_s16_planar_to_f32(const int16_t *in_i, const int16_t *in_q, float *out, size_t n, float scale);
+void convert_generic_cs12_to_f32(const uint8_t *in, float *out, size_t n, float scale);
+void convert_generic_f32_to_cs12(const float *in, uint8_t *out, size_t n, float scale);
+void convert_generic_s24_to_f32(const uint8_t *in, float *out, size_t n, float scale);
+void convert_generic_u4_lut_to_f32(const uint8_t *in, float *out, size_t n, const int8_t *table, float scale);
+
+void convert_init_generic(convert_kernels_t *k);
+#ifdef HAVE_CONVERT_SSE2
+void convert_init_sse2(convert_kernels_t *k);
+#endif
+#ifdef HAVE_CONVERT_AVX2
+void convert_init_avx2(convert_kernels_t *k);
+#endif
+#ifdef HAVE_CONVERT_AVX512
+void convert_init_avx512(convert_kernels_t *k);
+#endif
+#ifdef HAVE_CONVERT_NEON
+void convert_init_neon(convert_kernels_t *k);
+#endif
+
+#endif // OSMOSDR_CONVERT_IMPL_H
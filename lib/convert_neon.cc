@@ -0,0 +1,199 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <arm_neon.h>
+
+#include "convert_impl.h"
+
+/* 16 unsigned bytes per iteration */
+static void u8_to_f32_neon(const uint8_t *in, float *out, size_t n, float offset, float scale)
+{
+  const float32x4_t off = vdupq_n_f32(offset);
+  const float32x4_t mul = vdupq_n_f32(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t x = vld1q_u8(in + i);
+    uint16x8_t lo = vmovl_u8(vget_low_u8(x));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(x));
+
+    vst1q_f32(out + i +  0, vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), off), mul));
+    vst1q_f32(out + i +  4, vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), off), mul));
+    vst1q_f32(out + i +  8, vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), off), mul));
+    vst1q_f32(out + i + 12, vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), off), mul));
+  }
+
+  convert_generic_u8_to_f32(in + i, out + i, n - i, offset, scale);
+}
+
+/* 16 shorts per iteration */
+static void s16_to_f32_neon(const int16_t *in, float *out, size_t n, float scale)
+{
+  const float32x4_t mul = vdupq_n_f32(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    int16x8_t x0 = vld1q_s16(in + i + 0);
+    int16x8_t x1 = vld1q_s16(in + i + 8);
+
+    vst1q_f32(out + i +  0, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x0))), mul));
+    vst1q_f32(out + i +  4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x0))), mul));
+    vst1q_f32(out + i +  8, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x1))), mul));
+    vst1q_f32(out + i + 12, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x1))), mul));
+  }
+
+  convert_generic_s16_to_f32(in + i, out + i, n - i, scale);
+}
+
+/* 8 complex samples per iteration */
+static void s16_planar_to_f32_neon(const int16_t *in_i, const int16_t *in_q, float *out, size_t n, float scale)
+{
+  const float32x4_t mul = vdupq_n_f32(scale);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    int16x8x2_t x = vzipq_s16(vld1q_s16(in_i + i), vld1q_s16(in_q + i));
+
+    vst1q_f32(out + i * 2 +  0, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x.val[0]))), mul));
+    vst1q_f32(out + i * 2 +  4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x.val[0]))), mul));
+    vst1q_f32(out + i * 2 +  8, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x.val[1]))), mul));
+    vst1q_f32(out + i * 2 + 12, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x.val[1]))), mul));
+  }
+
+  convert_generic_s16_planar_to_f32(in_i + i, in_q + i, out + i * 2, n - i, scale);
+}
+
+/* the high byte sign extended and shifted up, or'ed with the low 16 bits */
+static inline float32x4_t s24_to_f32x4(uint16x4_t lo, int16x4_t hi, float32x4_t mul)
+{
+  int32x4_t x = vorrq_s32(vshll_n_s16(hi, 16), vreinterpretq_s32_u32(vmovl_u16(lo)));
+
+  return vmulq_f32(vcvtq_f32_s32(x), mul);
+}
+
+/* 16 packed 24 bit scalars per iteration, vld3 splits them into byte planes */
+static void s24_to_f32_neon(const uint8_t *in, float *out, size_t n, float scale)
+{
+  const float32x4_t mul = vdupq_n_f32(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    uint8x16x3_t x = vld3q_u8(in + i * 3);
+    uint8x16x2_t lo = vzipq_u8(x.val[0], x.val[1]);
+    uint16x8_t lo0 = vreinterpretq_u16_u8(lo.val[0]);
+    uint16x8_t lo1 = vreinterpretq_u16_u8(lo.val[1]);
+    int16x8_t hi0 = vmovl_s8(vget_low_s8(vreinterpretq_s8_u8(x.val[2])));
+    int16x8_t hi1 = vmovl_s8(vget_high_s8(vreinterpretq_s8_u8(x.val[2])));
+
+    vst1q_f32(out + i +  0, s24_to_f32x4(vget_low_u16(lo0), vget_low_s16(hi0), mul));
+    vst1q_f32(out + i +  4, s24_to_f32x4(vget_high_u16(lo0), vget_high_s16(hi0), mul));
+    vst1q_f32(out + i +  8, s24_to_f32x4(vget_low_u16(lo1), vget_low_s16(hi1), mul));
+    vst1q_f32(out + i + 12, s24_to_f32x4(vget_high_u16(lo1), vget_high_s16(hi1), mul));
+  }
+
+  convert_generic_s24_to_f32(in + i * 3, out + i, n - i, scale);
+}
+
+static inline void s8x16_to_f32(int8x16_t x, float *out, float32x4_t mul)
+{
+  int16x8_t lo = vmovl_s8(vget_low_s8(x));
+  int16x8_t hi = vmovl_s8(vget_high_s8(x));
+
+  vst1q_f32(out +  0, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))), mul));
+  vst1q_f32(out +  4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))), mul));
+  vst1q_f32(out +  8, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))), mul));
+  vst1q_f32(out + 12, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))), mul));
+}
+
+/* 16 bytes (32 codes) per iteration, the table lookup is a vtbl */
+static void u4_lut_to_f32_neon(const uint8_t *in, float *out, size_t n, const int8_t *table, float scale)
+{
+  const float32x4_t mul = vdupq_n_f32(scale);
+  const uint8x16_t mask = vdupq_n_u8(0x0f);
+#ifdef __aarch64__
+  const int8x16_t lut = vld1q_s8(table);
+#else
+  int8x8x2_t lut;
+  lut.val[0] = vld1_s8(table);
+  lut.val[1] = vld1_s8(table + 8);
+#endif
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t x = vld1q_u8(in + i);
+    uint8x16x2_t idx = vzipq_u8(vshrq_n_u8(x, 4), vandq_u8(x, mask));
+#ifdef __aarch64__
+    int8x16_t a = vqtbl1q_s8(lut, idx.val[0]);
+    int8x16_t b = vqtbl1q_s8(lut, idx.val[1]);
+#else
+    int8x16_t a = vcombine_s8(vtbl2_s8(lut, vreinterpret_s8_u8(vget_low_u8(idx.val[0]))),
+                              vtbl2_s8(lut, vreinterpret_s8_u8(vget_high_u8(idx.val[0]))));
+    int8x16_t b = vcombine_s8(vtbl2_s8(lut, vreinterpret_s8_u8(vget_low_u8(idx.val[1]))),
+                              vtbl2_s8(lut, vreinterpret_s8_u8(vget_high_u8(idx.val[1]))));
+#endif
+
+    s8x16_to_f32(a, out + i * 2, mul);
+    s8x16_to_f32(b, out + i * 2 + 16, mul);
+  }
+
+  convert_generic_u4_lut_to_f32(in + i, out + i * 2, n - i, table, scale);
+}
+
+#ifdef __aarch64__
+/*
+ * 16 floats per iteration. vcvtnq rounds to nearest even like lrintf()
+ * and the narrowing moves saturate, so no clamp is needed. ARMv7 only
+ * has a truncating conversion and keeps the generic kernel.
+ */
+static void f32_to_s8_neon(const float *in, int8_t *out, size_t n, float scale)
+{
+  const float32x4_t mul = vdupq_n_f32(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    int32x4_t a = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i +  0), mul));
+    int32x4_t b = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i +  4), mul));
+    int32x4_t c = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i +  8), mul));
+    int32x4_t d = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i + 12), mul));
+    int16x8_t ab = vcombine_s16(vqmovn_s32(a), vqmovn_s32(b));
+    int16x8_t cd = vcombine_s16(vqmovn_s32(c), vqmovn_s32(d));
+
+    vst1q_s8(out + i, vcombine_s8(vqmovn_s16(ab), vqmovn_s16(cd)));
+  }
+
+  convert_generic_f32_to_s8(in + i, out + i, n - i, scale);
+}
+#endif
+
+void convert_init_neon(convert_kernels_t *k)
+{
+  k->u8_to_f32 = u8_to_f32_neon;
+  k->s16_to_f32 = s16_to_f32_neon;
+  k->s16_planar_to_f32 = s16_planar_to_f32_neon;
+  k->s24_to_f32 = s24_to_f32_neon;
+  k->u4_lut_to_f32 = u4_lut_to_f32_neon;
+#ifdef __aarch64__
+  k->f32_to_s8 = f32_to_s8_neon;
+#endif
+}
@@ -0,0 +1,204 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <emmintrin.h>
+
+#include "convert_impl.h"
+
+/* 16 unsigned bytes per iteration */
+static void u8_to_f32_sse2(const uint8_t *in, float *out, size_t n, float offset, float scale)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 off = _mm_set1_ps(offset);
+  const __m128 mul = _mm_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i lo = _mm_unpacklo_epi8(x, zero);
+    __m128i hi = _mm_unpackhi_epi8(x, zero);
+
+    _mm_storeu_ps(out + i +  0, _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), off), mul));
+    _mm_storeu_ps(out + i +  4, _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), off), mul));
+    _mm_storeu_ps(out + i +  8, _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), off), mul));
+    _mm_storeu_ps(out + i + 12, _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), off), mul));
+  }
+
+  convert_generic_u8_to_f32(in + i, out + i, n - i, offset, scale);
+}
+
+/* sign extension by interleaving with itself and shifting back */
+static inline __m128 s16lo_to_f32(__m128i x)
+{
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+}
+
+static inline __m128 s16hi_to_f32(__m128i x)
+{
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+}
+
+/* 16 signed bytes per iteration */
+static void s8_to_f32_sse2(const int8_t *in, float *out, size_t n, float scale)
+{
+  const __m128 mul = _mm_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+    __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+
+    _mm_storeu_ps(out + i +  0, _mm_mul_ps(s16lo_to_f32(lo), mul));
+    _mm_storeu_ps(out + i +  4, _mm_mul_ps(s16hi_to_f32(lo), mul));
+    _mm_storeu_ps(out + i +  8, _mm_mul_ps(s16lo_to_f32(hi), mul));
+    _mm_storeu_ps(out + i + 12, _mm_mul_ps(s16hi_to_f32(hi), mul));
+  }
+
+  convert_generic_s8_to_f32(in + i, out + i, n - i, scale);
+}
+
+/* 16 shorts per iteration */
+static void s16_to_f32_sse2(const int16_t *in, float *out, size_t n, float scale)
+{
+  const __m128 mul = _mm_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i x0 = _mm_loadu_si128((const __m128i *)(in + i + 0));
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(in + i + 8));
+
+    _mm_storeu_ps(out + i +  0, _mm_mul_ps(s16lo_to_f32(x0), mul));
+    _mm_storeu_ps(out + i +  4, _mm_mul_ps(s16hi_to_f32(x0), mul));
+    _mm_storeu_ps(out + i +  8, _mm_mul_ps(s16lo_to_f32(x1), mul));
+    _mm_storeu_ps(out + i + 12, _mm_mul_ps(s16hi_to_f32(x1), mul));
+  }
+
+  convert_generic_s16_to_f32(in + i, out + i, n - i, scale);
+}
+
+/* 8 complex samples per iteration, interleaving is a 16 bit unpack */
+static void s16_planar_to_f32_sse2(const int16_t *in_i, const int16_t *in_q, float *out, size_t n, float scale)
+{
+  const __m128 mul = _mm_set1_ps(scale);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i re = _mm_loadu_si128((const __m128i *)(in_i + i));
+    __m128i im = _mm_loadu_si128((const __m128i *)(in_q + i));
+    __m128i lo = _mm_unpacklo_epi16(re, im);
+    __m128i hi = _mm_unpackhi_epi16(re, im);
+
+    _mm_storeu_ps(out + i * 2 +  0, _mm_mul_ps(s16lo_to_f32(lo), mul));
+    _mm_storeu_ps(out + i * 2 +  4, _mm_mul_ps(s16hi_to_f32(lo), mul));
+    _mm_storeu_ps(out + i * 2 +  8, _mm_mul_ps(s16lo_to_f32(hi), mul));
+    _mm_storeu_ps(out + i * 2 + 12, _mm_mul_ps(s16hi_to_f32(hi), mul));
+  }
+
+  convert_generic_s16_planar_to_f32(in_i + i, in_q + i, out + i * 2, n - i, scale);
+}
+
+/*
+ * Clamp in the float domain before converting: cvtps2dq returns 0x80000000
+ * for anything out of the int32 range, which the pack instructions would
+ * saturate towards the wrong end for large positive values.
+ */
+static inline __m128i f32_to_s32(__m128 x, __m128 mul, __m128 off, __m128 lo, __m128 hi)
+{
+  return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(x, mul), off), lo), hi));
+}
+
+static void f32_to_u8_sse2(const float *in, uint8_t *out, size_t n, float offset, float scale)
+{
+  const __m128 off = _mm_set1_ps(offset);
+  const __m128 mul = _mm_set1_ps(scale);
+  const __m128 lo = _mm_set1_ps(0.0f);
+  const __m128 hi = _mm_set1_ps(255.0f);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = f32_to_s32(_mm_loadu_ps(in + i +  0), mul, off, lo, hi);
+    __m128i b = f32_to_s32(_mm_loadu_ps(in + i +  4), mul, off, lo, hi);
+    __m128i c = f32_to_s32(_mm_loadu_ps(in + i +  8), mul, off, lo, hi);
+    __m128i d = f32_to_s32(_mm_loadu_ps(in + i + 12), mul, off, lo, hi);
+
+    _mm_storeu_si128((__m128i *)(out + i),
+                     _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+  }
+
+  convert_generic_f32_to_u8(in + i, out + i, n - i, offset, scale);
+}
+
+static void f32_to_s8_sse2(const float *in, int8_t *out, size_t n, float scale)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 mul = _mm_set1_ps(scale);
+  const __m128 lo = _mm_set1_ps(-128.0f);
+  const __m128 hi = _mm_set1_ps(127.0f);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = f32_to_s32(_mm_loadu_ps(in + i +  0), mul, zero, lo, hi);
+    __m128i b = f32_to_s32(_mm_loadu_ps(in + i +  4), mul, zero, lo, hi);
+    __m128i c = f32_to_s32(_mm_loadu_ps(in + i +  8), mul, zero, lo, hi);
+    __m128i d = f32_to_s32(_mm_loadu_ps(in + i + 12), mul, zero, lo, hi);
+
+    _mm_storeu_si128((__m128i *)(out + i),
+                     _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+  }
+
+  convert_generic_f32_to_s8(in + i, out + i, n - i, scale);
+}
+
+static void f32_to_s16_sse2(const float *in, int16_t *out, size_t n, float scale, float peak)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 mul = _mm_set1_ps(scale);
+  const __m128 lo = _mm_set1_ps(-peak);
+  const __m128 hi = _mm_set1_ps(peak);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = f32_to_s32(_mm_loadu_ps(in + i +  0), mul, zero, lo, hi);
+    __m128i b = f32_to_s32(_mm_loadu_ps(in + i +  4), mul, zero, lo, hi);
+    __m128i c = f32_to_s32(_mm_loadu_ps(in + i +  8), mul, zero, lo, hi);
+    __m128i d = f32_to_s32(_mm_loadu_ps(in + i + 12), mul, zero, lo, hi);
+
+    _mm_storeu_si128((__m128i *)(out + i + 0), _mm_packs_epi32(a, b));
+    _mm_storeu_si128((__m128i *)(out + i + 8), _mm_packs_epi32(c, d));
+  }
+
+  convert_generic_f32_to_s16(in + i, out + i, n - i, scale, peak);
+}
+
+void convert_init_sse2(convert_kernels_t *k)
+{
+  k->u8_to_f32 = u8_to_f32_sse2;
+  k->s8_to_f32 = s8_to_f32_sse2;
+  k->s16_to_f32 = s16_to_f32_sse2;
+  k->f32_to_u8 = f32_to_u8_sse2;
+  k->f32_to_s8 = f32_to_s8_sse2;
+  k->f32_to_s16 = f32_to_s16_sse2;
+  k->s16_planar_to_f32 = s16_planar_to_f32_sse2;
+}
@@ -31,15 +31,9 @@
 #include <stdexcept>
 #include <iostream>
 #include <algorithm>
-#ifdef USE_AVX
-#include <immintrin.h>
-#elif USE_SSE2
-#include <emmintrin.h>
-#endif
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
-#include <boost/detail/endian.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/thread/thread.hpp>
 
@@ -48,12 +42,17 @@
 #include "hackrf_sink_c.h"
 
 #include "arg_helpers.h"
+#include "convert.h"
+#include "latency_helpers.h"
 
 using namespace boost::assign;
 
 #define BUF_LEN  (16 * 32 * 512) /* must be multiple of 512 */
 #define BUF_NUM   15
 
+/* longest work() blocks on a full queue before it returns to the scheduler */
+#define TX_WAIT_USEC 10000
+
 #define BYTES_PER_SAMPLE  2 /* HackRF device consumes 8 bit unsigned IQ data */
 
 #define HACKRF_FORMAT_ERROR(ret) \
@@ -68,64 +67,6 @@ using namespace boost::assign;
 #define HACKRF_FUNC_STR(func, arg) \
   boost::str(boost::format(func "(%d)") % arg) + " has failed"
 
-static inline bool cb_init(circular_buffer_t *cb, size_t capacity, size_t sz)
-{
-  cb->buffer = malloc(capacity * sz);
-  if(cb->buffer == NULL)
-    return false; // handle error
-  cb->buffer_end = (int8_t *)cb->buffer + capacity * sz;
-  cb->capacity = capacity;
-  cb->count = 0;
-  cb->sz = sz;
-  cb->head = cb->buffer;
-  cb->tail = cb->buffer;
-  return true;
-}
-
-static inline void cb_free(circular_buffer_t *cb)
-{
-  free(cb->buffer);
-  cb->buffer = NULL;
-  // clear out other fields too, just to be safe
-  cb->buffer_end = 0;
-  cb->capacity = 0;
-  cb->count = 0;
-  cb->sz = 0;
-  cb->head = 0;
-  cb->tail = 0;
-}
-
-static inline bool cb_has_room(circular_buffer_t *cb)
-{
-  if(cb->count == cb->capacity)
-    return false;
-  return true;
-}
-
-static inline bool cb_push_back(circular_buffer_t *cb, const void *item)
-{
-  if(cb->count == cb->capacity)
-    return false; // handle error
-  memcpy(cb->head, item, cb->sz);
-  cb->head = (int8_t *)cb->head + cb->sz;
-  if(cb->head == cb->buffer_end)
-    cb->head = cb->buffer;
-  cb->count++;
-  return true;
-}
-
-static inline bool cb_pop_front(circular_buffer_t *cb, void *item)
-{
-  if(cb->count == 0)
-    return false; // handle error
-  memcpy(item, cb->tail, cb->sz);
-  cb->tail = (int8_t *)cb->tail + cb->sz;
-  if(cb->tail == cb->buffer_end)
-    cb->tail = cb->buffer;
-  cb->count--;
-  return true;
-}
-
 int hackrf_sink_c::_usage = 0;
 boost::mutex hackrf_sink_c::_usage_mutex;
 
@@ -157,6 +98,11 @@ hackrf_sink_c::hackrf_sink_c (const std::string &args)
         gr::io_signature::make(MIN_OUT, MAX_OUT, sizeof (gr_complex))),
     _dev(NULL),
     _buf(NULL),
+    _buf_used(0),
+    _queue_slots(0),
+    _latency_ms(0),
+    _underruns(0),
+    _max_queued(0),
     _sample_rate(0),
     _center_freq(0),
     _freq_corr(0),
@@ -181,6 +127,11 @@ hackrf_sink_c::hackrf_sink_c (const std::string &args)
   if (0 == _buf_num)
     _buf_num = BUF_NUM;
 
+  if (dict.count("tx_latency_ms"))
+    _latency_ms = boost::lexical_cast< double >( dict["tx_latency_ms"] );
+
+  _queue_slots = _buf_num;
+
   {
     boost::mutex::scoped_lock lock( _usage_mutex );
 
@@ -243,9 +194,9 @@ hackrf_sink_c::hackrf_sink_c (const std::string &args)
     }
   }
 
-  _buf = (int8_t *) malloc( BUF_LEN );
+  _buf = (int8_t *) malloc( _buf_num * BUF_LEN );
 
-  cb_init( &_cbuf, _buf_num, BUF_LEN );
+  _ring.reset( _buf_num );
 
 //  _thread = gr::thread::thread(_hackrf_wait, this);
 
@@ -278,8 +229,6 @@ hackrf_sink_c::~hackrf_sink_c ()
 
   free(_buf);
   _buf = NULL;
-
-  cb_free( &_cbuf );
 }
 
 int hackrf_sink_c::_hackrf_tx_callback(hackrf_transfer *transfer)
@@ -288,24 +237,32 @@ int hackrf_sink_c::_hackrf_tx_callback(hackrf_transfer *transfer)
   return obj->hackrf_tx_callback(transfer->buffer, transfer->valid_length);
 }
 
+/*
+ * libhackrf owns the transfer buffers, so the slot filled by work() is
+ * copied exactly once, here. No lock is taken unless work() is parked.
+ */
 int hackrf_sink_c::hackrf_tx_callback(unsigned char *buffer, uint32_t length)
 {
-#if 0
-  for (unsigned int i = 0; i < length; ++i) /* simulate noise */
-    *buffer++ = rand() % 255;
-#else
-  {
-    boost::mutex::scoped_lock lock( _buf_mutex );
+  size_t queued = _ring.size();
 
-    if ( ! cb_pop_front( &_cbuf, buffer ) ) {
-      memset(buffer, 0, length);
-      std::cerr << "U" << std::flush;
-    } else {
-//      std::cerr << "-" << std::flush;
-      _buf_cond.notify_one();
-    }
+  if ( queued == 0 ) {
+    memset(buffer, 0, length);
+    _underruns++;
+    std::cerr << "U" << std::flush;
+    return 0;
   }
-#endif
+
+  if ( queued > _max_queued )
+    _max_queued = queued;
+
+  uint32_t len = std::min( length, (uint32_t)BUF_LEN );
+
+  memcpy( buffer, _buf + _ring.head() * BUF_LEN, len );
+  if ( len < length )
+    memset( buffer + len, 0, length - len );
+
+  _ring.pop();
+
   return 0; // TODO: return -1 on error/stop
 }
 
@@ -323,7 +280,10 @@ bool hackrf_sink_c::start()
   if ( ! _dev )
     return false;
 
-  _buf_used = 0;
+  /* TX keeps streaming between runs, so the queued slots are kept */
+  _ring.resume();
+  _underruns = 0;
+  _max_queued = _ring.size();
 #if 0
   int ret = hackrf_start_tx( _dev, _hackrf_tx_callback, (void *)this );
   if ( ret != HACKRF_SUCCESS ) {
@@ -338,6 +298,9 @@ bool hackrf_sink_c::stop()
 {
   if ( ! _dev )
     return false;
+
+  /* releases work() if it waits for a free slot */
+  _ring.stop();
 #if 0
   int ret = hackrf_stop_tx( _dev );
   if ( ret != HACKRF_SUCCESS ) {
@@ -348,124 +311,73 @@ bool hackrf_sink_c::stop()
   return true;
 }
 
-#ifdef USE_AVX
-void convert_avx(const float* inbuf, int8_t* outbuf,const unsigned int count)
+int hackrf_sink_c::work( int noutput_items,
+                         gr_vector_const_void_star &input_items,
+                         gr_vector_void_star &output_items )
 {
-  __m256 mulme = _mm256_set_ps(127.0f, 127.0f, 127.0f, 127.0f, 127.0f, 127.0f, 127.0f, 127.0f);
-  for(unsigned int i=0; i<count;i++){
-
-  __m256i itmp3 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(&inbuf[i*16+0]), mulme));
-  __m256i itmp4 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(&inbuf[i*16+8]), mulme));
-
-  __m128i a1 = _mm256_extractf128_si256(itmp3, 1);
-  __m128i a0 = _mm256_castsi256_si128(itmp3);
-  __m128i a3 = _mm256_extractf128_si256(itmp4, 1);
-  __m128i a2 = _mm256_castsi256_si128(itmp4);
-
-  __m128i outshorts1 = _mm_packs_epi32(a0, a1);
-  __m128i outshorts2 = _mm_packs_epi32(a2, a3);
-
-  __m128i outbytes = _mm_packs_epi16(outshorts1, outshorts2);
-
-  _mm_storeu_si128 ((__m128i*)&outbuf[i*16], outbytes);
-  }
-}
+  const gr_complex *in = (const gr_complex *) input_items[0];
+  int items_consumed = 0;
 
-#elif USE_SSE2
-void convert_sse2(const float* inbuf, int8_t* outbuf,const unsigned int count)
-{
-  const register __m128 mulme = _mm_set_ps( 127.0f, 127.0f, 127.0f, 127.0f );
-  __m128 itmp1,itmp2,itmp3,itmp4;
-  __m128i otmp1,otmp2,otmp3,otmp4;
+  /*
+   * At most _queue_slots published slots may be waiting for the device,
+   * the one at the tail is being filled and may hold a partial chunk from
+   * earlier calls. On a full queue we wait for a bounded time only and
+   * then give the thread back to the scheduler.
+   */
+  size_t reserve = _ring.capacity() - _queue_slots + 1;
 
-  __m128i outshorts1,outshorts2;
-  __m128i outbytes;
+  if ( ! _ring.wait_space( reserve, 0, TX_WAIT_USEC ) )
+    return WORK_DONE;
 
-  for(unsigned int i=0; i<count;i++){
+  while ( items_consumed < noutput_items && _ring.space() >= reserve ) {
+    int8_t *buf = _buf + _ring.tail() * BUF_LEN + _buf_used;
 
-  itmp1 = _mm_mul_ps(_mm_loadu_ps(&inbuf[i*16+0]), mulme);
-  itmp2 = _mm_mul_ps(_mm_loadu_ps(&inbuf[i*16+4]), mulme);
-  itmp3 = _mm_mul_ps(_mm_loadu_ps(&inbuf[i*16+8]), mulme);
-  itmp4 = _mm_mul_ps(_mm_loadu_ps(&inbuf[i*16+12]), mulme);
+    unsigned int remaining = (BUF_LEN-_buf_used)/2; //complex
 
-  otmp1 = _mm_cvtps_epi32(itmp1);
-  otmp2 = _mm_cvtps_epi32(itmp2);
-  otmp3 = _mm_cvtps_epi32(itmp3);
-  otmp4 = _mm_cvtps_epi32(itmp4);
+    unsigned int count = std::min((unsigned int)(noutput_items - items_consumed), remaining);
 
-  outshorts1 = _mm_packs_epi32(otmp1, otmp2);
-  outshorts2 = _mm_packs_epi32(otmp3, otmp4);
+    convert_cf32_to_cs8(in + items_consumed, buf, count, 127.0f);
 
-  outbytes = _mm_packs_epi16(outshorts1, outshorts2);
+    _buf_used += count*2;
+    items_consumed += count;
 
-  _mm_storeu_si128 ((__m128i*)&outbuf[i*16], outbytes);
+    if ( _buf_used == BUF_LEN ) {
+      _ring.push();
+      _buf_used = 0;
+    }
   }
+
+  // Tell runtime system how many input items we consumed.
+  return items_consumed;
 }
-#endif
 
-void convert_default(float* inbuf, int8_t* outbuf,const unsigned int count)
+/*
+ * The queue granularity is one transfer (BUF_LEN bytes), libhackrf asks
+ * for that much at a time. Without tx_latency_ms all slots are used.
+ */
+void hackrf_sink_c::set_queue_depth()
 {
-  for(unsigned int i=0; i<count;i++){
-    outbuf[i]= inbuf[i]*127;
-  }
+  if ( _latency_ms > 0 )
+    _queue_slots = latency_to_prefill( _sample_rate, _latency_ms, BUF_LEN,
+                                       BYTES_PER_SAMPLE, _buf_num );
+  else
+    _queue_slots = _buf_num;
 }
 
-int hackrf_sink_c::work( int noutput_items,
-                         gr_vector_const_void_star &input_items,
-                         gr_vector_void_star &output_items )
+double hackrf_sink_c::get_latency( size_t mboard )
 {
-  const gr_complex *in = (const gr_complex *) input_items[0];
-
-  {
-    boost::mutex::scoped_lock lock( _buf_mutex );
-
-    while ( ! cb_has_room(&_cbuf) )
-      _buf_cond.wait( lock );
-  }
-
-  int8_t *buf = _buf + _buf_used;
-  unsigned int prev_buf_used = _buf_used;
-
-  unsigned int remaining = (BUF_LEN-_buf_used)/2; //complex
+  if ( _sample_rate <= 0 )
+    return 0;
 
-  unsigned int count = std::min((unsigned int)noutput_items,remaining);
-  unsigned int sse_rem = count/8; // 8 complex = 16f==512bit for avx
-  unsigned int nosse_rem = count%8; // remainder
-
-#ifdef USE_AVX
-  convert_avx((float*)in, buf, sse_rem);
-  convert_default((float*)(in+sse_rem*8), buf+(sse_rem*8*2), nosse_rem*2);
-#elif USE_SSE2
-  convert_sse2((float*)in, buf, sse_rem);
-  convert_default((float*)(in+sse_rem*8), buf+(sse_rem*8*2), nosse_rem*2);
-#else
-  convert_default((float*)in, buf, count*2);
-#endif
-
-  _buf_used += (sse_rem*8+nosse_rem)*2;
-  int items_consumed = sse_rem*8+nosse_rem;
-
-  if((unsigned int)noutput_items >= remaining) {
-    {
-      boost::mutex::scoped_lock lock( _buf_mutex );
-
-      if ( ! cb_push_back( &_cbuf, _buf ) ) {
-        _buf_used = prev_buf_used;
-        items_consumed = 0;
-        std::cerr << "O" << std::flush;
-      } else {
-//        std::cerr << "+" << std::flush;
-        _buf_used = 0;
-      }
-    }
-  }
+  return _ring.size() * (BUF_LEN / BYTES_PER_SAMPLE) / _sample_rate;
+}
 
-  // Tell runtime system how many input items we consumed on
-  // each input stream.
-  consume_each(items_consumed);
+double hackrf_sink_c::get_max_latency( size_t mboard )
+{
+  if ( _sample_rate <= 0 )
+    return 0;
 
-  // Tell runtime system how many output items we produced.
-  return 0;
+  return _max_queued * (BUF_LEN / BYTES_PER_SAMPLE) / _sample_rate;
 }
 
 std::vector<std::string> hackrf_sink_c::get_devices()
@@ -574,6 +486,7 @@ double hackrf_sink_c::set_sample_rate( double rate )
     ret = hackrf_set_sample_rate( _dev, rate );
     if ( HACKRF_SUCCESS == ret ) {
       _sample_rate = rate;
+      set_queue_depth();
       //set_bandwidth( 0.0 ); /* bandwidth of 0 means automatic filter selection */
     } else {
       HACKRF_THROW_ON_ERROR( ret, HACKRF_FUNC_STR( "hackrf_set_sample_rate", rate ) )
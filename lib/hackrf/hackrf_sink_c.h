@@ -25,24 +25,15 @@
 
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/atomic.hpp>
 
 #include <libhackrf/hackrf.h>
 
 #include "sink_iface.h"
+#include "spsc_ring.h"
 
 class hackrf_sink_c;
 
-typedef struct circular_buffer
-{
-  void *buffer;     // data buffer
-  void *buffer_end; // end of data buffer
-  size_t capacity;  // maximum number of items in the buffer
-  size_t count;     // number of items in the buffer
-  size_t sz;        // size of each item in the buffer
-  void *head;       // pointer to head
-  void *tail;       // pointer to tail
-} circular_buffer_t;
-
 /*
  * We use boost::shared_ptr's instead of raw pointers for all access
  * to gr::blocks (and many other data structures).  The shared_ptr gets
@@ -121,11 +112,18 @@ public:
   double get_bandwidth( size_t chan = 0 );
   osmosdr::freq_range_t get_bandwidth_range( size_t chan = 0 );
 
+  /* transfers sent as silence because no samples were queued */
+  unsigned long get_underruns( size_t mboard = 0 ) { return _underruns; }
+  /* seconds of samples queued ahead of the device, now and at most */
+  double get_latency( size_t mboard = 0 );
+  double get_max_latency( size_t mboard = 0 );
+
 private:
   static int _hackrf_tx_callback(hackrf_transfer* transfer);
   int hackrf_tx_callback(unsigned char *buffer, uint32_t length);
   static void _hackrf_wait(hackrf_sink_c *obj);
   void hackrf_wait();
+  void set_queue_depth();
 
   static int _usage;
   static boost::mutex _usage_mutex;
@@ -133,12 +131,18 @@ private:
   hackrf_device *_dev;
 //  gr::thread::thread _thread;
 
-  circular_buffer_t _cbuf;
+  /* _buf_num slots of BUF_LEN bytes, work() converts straight into them */
   int8_t *_buf;
   unsigned int _buf_num;
   unsigned int _buf_used;
-  boost::mutex _buf_mutex;
-  boost::condition_variable _buf_cond;
+  spsc_ring _ring;
+
+  /* how many slots work() may queue, derived from tx_latency_ms */
+  boost::atomic< unsigned int > _queue_slots;
+  double _latency_ms;
+
+  boost::atomic< unsigned long > _underruns;
+  boost::atomic< size_t > _max_queued;
 
   double _sample_rate;
   double _center_freq;
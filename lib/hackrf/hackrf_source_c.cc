@@ -32,7 +32,6 @@
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
-#include <boost/detail/endian.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/thread/thread.hpp>
 
@@ -41,6 +40,7 @@
 #include "hackrf_source_c.h"
 
 #include "arg_helpers.h"
+#include "convert.h"
 
 using namespace boost::assign;
 
@@ -122,17 +122,6 @@ hackrf_source_c::hackrf_source_c (const std::string &args)
 
   _samp_avail = _buf_len / BYTES_PER_SAMPLE;
 
-  // create a lookup table for gr_complex values
-  for (unsigned int i = 0; i <= 0xffff; i++) {
-#ifdef BOOST_LITTLE_ENDIAN
-    _lut.push_back( gr_complex( (float(int8_t(i & 0xff))) * (1.0f/128.0f),
-                                (float(int8_t(i >> 8))) * (1.0f/128.0f) ) );
-#else // BOOST_BIG_ENDIAN
-    _lut.push_back( gr_complex( (float(int8_t(i >> 8))) * (1.0f/128.0f),
-                                (float(int8_t(i & 0xff))) * (1.0f/128.0f) ) );
-#endif
-  }
-
   {
     boost::mutex::scoped_lock lock( _usage_mutex );
 
@@ -356,14 +345,13 @@ int hackrf_source_c::work( int noutput_items,
   unsigned short *buf = _buf[_buf_head] + _buf_offset;
 
   if (noutput_items <= _samp_avail) {
-    for (int i = 0; i < noutput_items; ++i)
-      *out++ = _lut[ *(buf + i) ];
+    convert_cs8_to_cf32( buf, out, noutput_items, 1.0f/128.0f );
 
     _buf_offset += noutput_items;
     _samp_avail -= noutput_items;
   } else {
-    for (int i = 0; i < _samp_avail; ++i)
-      *out++ = _lut[ *(buf + i) ];
+    convert_cs8_to_cf32( buf, out, _samp_avail, 1.0f/128.0f );
+    out += _samp_avail;
 
     {
       boost::mutex::scoped_lock lock( _buf_mutex );
@@ -376,8 +364,7 @@ int hackrf_source_c::work( int noutput_items,
 
     int remaining = noutput_items - _samp_avail;
 
-    for (int i = 0; i < remaining; ++i)
-      *out++ = _lut[ *(buf + i) ];
+    convert_cs8_to_cf32( buf, out, remaining, 1.0f/128.0f );
 
     _buf_offset = remaining;
     _samp_avail = (_buf_len / BYTES_PER_SAMPLE) - remaining;
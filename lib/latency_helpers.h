@@ -0,0 +1,75 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef OSMOSDR_LATENCY_HELPERS_H
+#define OSMOSDR_LATENCY_HELPERS_H
+
+/*
+ * Buffer sizing for the USB sources which collect a number of transfer
+ * buffers ("prefill") before handing samples downstream. The resulting
+ * latency is about prefill * buflen / (rate * bytes_per_sample).
+ */
+
+/*!
+ * Returns the buffer length in bytes for which prefill buffers hold
+ * latency_ms worth of samples, rounded down to a multiple of align and
+ * limited to [min_len, max_len]. Returns max_len if the rate is unknown.
+ */
+inline unsigned int latency_to_buflen( double rate, double latency_ms,
+                                       unsigned int prefill,
+                                       unsigned int bytes_per_sample,
+                                       unsigned int align,
+                                       unsigned int min_len,
+                                       unsigned int max_len )
+{
+  if ( rate <= 0 || latency_ms <= 0 || 0 == prefill )
+    return max_len;
+
+  double len = rate * bytes_per_sample * latency_ms / 1e3 / prefill;
+
+  if ( len >= max_len )
+    return max_len;
+
+  unsigned int buflen = (unsigned int)(len / align) * align;
+
+  return buflen < min_len ? min_len : buflen;
+}
+
+/*!
+ * Returns how many buffers of buflen bytes fit into latency_ms, at least
+ * one and at most max_prefill.
+ */
+inline unsigned int latency_to_prefill( double rate, double latency_ms,
+                                        unsigned int buflen,
+                                        unsigned int bytes_per_sample,
+                                        unsigned int max_prefill )
+{
+  if ( rate <= 0 || latency_ms <= 0 || 0 == buflen )
+    return 1;
+
+  double n = rate * bytes_per_sample * latency_ms / 1e3 / buflen;
+
+  if ( n < 1 )
+    return 1;
+
+  return n > max_prefill ? max_prefill : (unsigned int)n;
+}
+
+#endif // OSMOSDR_LATENCY_HELPERS_H
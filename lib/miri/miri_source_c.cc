@@ -41,12 +41,15 @@
 #include <mirisdr.h>
 
 #include "arg_helpers.h"
+#include "convert.h"
+#include "latency_helpers.h"
 
 using namespace boost::assign;
 
 #define BUF_SIZE  2304 * 8 * 2
 #define BUF_NUM   15
 #define BUF_SKIP  1 // buffers to skip due to garbage
+#define PREFILL   3 // buffers to collect before returning samples
 
 #define BYTES_PER_SAMPLE  4 // mirisdr device delivers 16 bit signed IQ data
                             // containing 12 bits of information
@@ -96,6 +99,8 @@ miri_source_c::miri_source_c (const std::string &args)
 
   _buf_num = _buf_head = _buf_used = _buf_offset = 0;
   _samp_avail = BUF_SIZE / BYTES_PER_SAMPLE;
+  _prefill = PREFILL;
+  _latency_ms = 0;
 
   if (dict.count("buffers"))
     _buf_num = boost::lexical_cast< unsigned int >( dict["buffers"] );
@@ -103,6 +108,13 @@ miri_source_c::miri_source_c (const std::string &args)
   if (0 == _buf_num)
     _buf_num = BUF_NUM;
 
+  if (dict.count("prefill"))
+    _prefill = std::max( 1u, boost::lexical_cast< unsigned int >( dict["prefill"] ) );
+
+  /* the buffers are small, only the prefill follows the sample rate */
+  if (dict.count("latency"))
+    _latency_ms = boost::lexical_cast< double >( dict["latency"] );
+
   if ( BUF_NUM != _buf_num ) {
     std::cerr << "Using " << _buf_num << " buffers of size " << BUF_SIZE << "."
               << std::endl;
@@ -132,6 +144,10 @@ miri_source_c::miri_source_c (const std::string &args)
   if (ret < 0)
     throw std::runtime_error("Failed to reset usb buffers.");
 
+  if (_latency_ms > 0)
+    _prefill = latency_to_prefill( get_sample_rate(), _latency_ms, BUF_SIZE,
+                                   BYTES_PER_SAMPLE, _buf_num );
+
   _buf = (unsigned short **) malloc(_buf_num * sizeof(unsigned short *));
   _buf_lens = (unsigned int *) malloc(_buf_num * sizeof(unsigned int));
 
@@ -228,7 +244,7 @@ int miri_source_c::work( int noutput_items,
   {
     boost::mutex::scoped_lock lock( _buf_mutex );
 
-    while (_buf_used < 3 && _running) // collect at least 3 buffers
+    while (_buf_used < std::min(_prefill, _buf_num) && _running) // collect the prefill buffers
       _buf_cond.wait( lock );
   }
 
@@ -238,16 +254,13 @@ int miri_source_c::work( int noutput_items,
   short *buf = (short *)_buf[_buf_head] + _buf_offset;
 
   if (noutput_items <= _samp_avail) {
-    for (int i = 0; i < noutput_items; i++)
-      *out++ = gr_complex( float(*(buf + i * 2 + 0)) * (1.0f/4096.0f),
-                           float(*(buf + i * 2 + 1)) * (1.0f/4096.0f) );
+    convert_cs16_to_cf32( buf, out, noutput_items, 1.0f/4096.0f );
 
     _buf_offset += noutput_items * 2;
     _samp_avail -= noutput_items;
   } else {
-    for (int i = 0; i < _samp_avail; i++)
-      *out++ = gr_complex( float(*(buf + i * 2 + 0)) * (1.0f/4096.0f),
-                           float(*(buf + i * 2 + 1)) * (1.0f/4096.0f) );
+    convert_cs16_to_cf32( buf, out, _samp_avail, 1.0f/4096.0f );
+    out += _samp_avail;
 
     {
       boost::mutex::scoped_lock lock( _buf_mutex );
@@ -260,9 +273,7 @@ int miri_source_c::work( int noutput_items,
 
     int remaining = noutput_items - _samp_avail;
 
-    for (int i = 0; i < remaining; i++)
-      *out++ = gr_complex( float(*(buf + i * 2 + 0)) * (1.0f/4096.0f),
-                           float(*(buf + i * 2 + 1)) * (1.0f/4096.0f) );
+    convert_cs16_to_cf32( buf, out, remaining, 1.0f/4096.0f );
 
     _buf_offset = remaining * 2;
     _samp_avail = (_buf_lens[_buf_head] / BYTES_PER_SAMPLE) - remaining;
@@ -304,6 +315,10 @@ double miri_source_c::set_sample_rate(double rate)
     mirisdr_set_sample_rate( _dev, (uint32_t)rate );
   }
 
+  if (_latency_ms > 0)
+    _prefill = latency_to_prefill( get_sample_rate(), _latency_ms, BUF_SIZE,
+                                   BYTES_PER_SAMPLE, _buf_num );
+
   return get_sample_rate();
 }
 
@@ -122,6 +122,8 @@ private:
   unsigned int _buf_used;
   boost::mutex _buf_mutex;
   boost::condition_variable _buf_cond;
+  unsigned int _prefill;
+  double _latency_ms;
   bool _running;
 
   unsigned int _buf_offset;
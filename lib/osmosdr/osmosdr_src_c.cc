@@ -40,12 +40,16 @@
 #include <osmosdr.h>
 
 #include "arg_helpers.h"
+#include "convert.h"
+#include "latency_helpers.h"
 
 using namespace boost::assign;
 
 #define BUF_LEN  (16 * 32 * 512) /* must be multiple of 512 */
 #define BUF_NUM   15
 #define BUF_SKIP  1 // buffers to skip due to garbage
+#define BUF_LEN_MIN (16 * 512) /* lower bound in latency mode */
+#define PREFILL   3 // buffers to collect before returning samples
 
 #define BYTES_PER_SAMPLE  4 // osmosdr device delivers 16 bit signed IQ data
 
@@ -82,6 +86,10 @@ osmosdr_src_c::osmosdr_src_c (const std::string &args)
     dev_index = boost::lexical_cast< unsigned int >( dict["osmosdr"] );
 
   _buf_num = _buf_len = _buf_head = _buf_used = _buf_offset = 0;
+  _prefill = PREFILL;
+  _latency_ms = 0;
+  bool fixed_len = dict.count("buflen") > 0;
+  unsigned int latency_prefill = 1;
 
   if (dict.count("buffers"))
     _buf_num = boost::lexical_cast< unsigned int >( dict["buffers"] );
@@ -95,13 +103,22 @@ osmosdr_src_c::osmosdr_src_c (const std::string &args)
   if (0 == _buf_len || _buf_len % 512 != 0) /* len must be multiple of 512 */
     _buf_len = BUF_LEN;
 
+  if (dict.count("prefill")) {
+    _prefill = boost::lexical_cast< unsigned int >( dict["prefill"] );
+    latency_prefill = _prefill;
+  }
+
+  if (0 == _prefill)
+    _prefill = latency_prefill = 1;
+
+  if (dict.count("latency"))
+    _latency_ms = boost::lexical_cast< double >( dict["latency"] );
+
   if ( BUF_NUM != _buf_num || BUF_LEN != _buf_len ) {
     std::cerr << "Using " << _buf_num << " buffers of size " << _buf_len << "."
               << std::endl;
   }
 
-  _samp_avail = _buf_len / BYTES_PER_SAMPLE;
-
   if ( dev_index >= osmosdr_get_device_count() )
     throw std::runtime_error("Wrong osmosdr device index given.");
 
@@ -132,6 +149,24 @@ osmosdr_src_c::osmosdr_src_c (const std::string &args)
 
   set_if_gain( 24 ); /* preset to a reasonable default (non-GRC use case) */
 
+  /*
+   * Streaming starts right away, so the buffers are sized for the lowest
+   * sample rate, which meets the latency target at any higher rate.
+   */
+  if (_latency_ms > 0 && !fixed_len) {
+    osmosdr::meta_range_t rates = get_sample_rates();
+
+    if (!rates.empty())
+      _buf_len = latency_to_buflen( rates.start(), _latency_ms, latency_prefill,
+                                    BYTES_PER_SAMPLE, 512, BUF_LEN_MIN, BUF_LEN );
+  }
+
+  _samp_avail = _buf_len / BYTES_PER_SAMPLE;
+
+  if (_latency_ms > 0)
+    _prefill = latency_to_prefill( get_sample_rate(), _latency_ms, _buf_len,
+                                   BYTES_PER_SAMPLE, _buf_num );
+
   _buf = (unsigned short **) malloc(_buf_num * sizeof(unsigned short *));
 
   if (_buf) {
@@ -221,7 +256,7 @@ int osmosdr_src_c::work( int noutput_items,
   {
     boost::mutex::scoped_lock lock( _buf_mutex );
 
-    while (_buf_used < 3 && _running) // collect at least 3 buffers
+    while (_buf_used < std::min(_prefill, _buf_num) && _running) // collect the prefill buffers
       _buf_cond.wait( lock );
   }
 
@@ -231,16 +266,13 @@ int osmosdr_src_c::work( int noutput_items,
   short *buf = (short *)_buf[_buf_head] + _buf_offset;
 
   if (noutput_items <= _samp_avail) {
-    for (int i = 0; i < noutput_items; i++)
-       *out++ = gr_complex( float(*(buf + i * 2 + 0)) * (1.0f/32767.5f),
-                            float(*(buf + i * 2 + 1)) * (1.0f/32767.5f) );
+    convert_cs16_to_cf32( buf, out, noutput_items, 1.0f/32767.5f );
 
     _buf_offset += noutput_items * 2;
     _samp_avail -= noutput_items;
   } else {
-    for (int i = 0; i < _samp_avail; i++)
-      *out++ = gr_complex( float(*(buf + i * 2 + 0)) * (1.0f/32767.5f),
-                           float(*(buf + i * 2 + 1)) * (1.0f/32767.5f) );
+    convert_cs16_to_cf32( buf, out, _samp_avail, 1.0f/32767.5f );
+    out += _samp_avail;
 
     {
       boost::mutex::scoped_lock lock( _buf_mutex );
@@ -253,9 +285,7 @@ int osmosdr_src_c::work( int noutput_items,
 
     int remaining = noutput_items - _samp_avail;
 
-    for (int i = 0; i < remaining; i++)
-      *out++ = gr_complex( float(*(buf + i * 2 + 0)) * (1.0f/32767.5f),
-                           float(*(buf + i * 2 + 1)) * (1.0f/32767.5f) );
+    convert_cs16_to_cf32( buf, out, remaining, 1.0f/32767.5f );
 
     _buf_offset = remaining * 2;
     _samp_avail = (_buf_len / BYTES_PER_SAMPLE) - remaining;
@@ -318,6 +348,11 @@ double osmosdr_src_c::set_sample_rate(double rate)
     osmosdr_set_sample_rate( _dev, (uint32_t)rate );
   }
 
+  /* the buffer length is fixed while streaming, adjust the prefill */
+  if (_latency_ms > 0)
+    _prefill = latency_to_prefill( get_sample_rate(), _latency_ms, _buf_len,
+                                   BYTES_PER_SAMPLE, _buf_num );
+
   return get_sample_rate();
 }
 
@@ -23,6 +23,9 @@
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <iostream>
+
+#include <errno.h>
 
 #include "redpitaya_common.h"
 
@@ -46,3 +49,31 @@ void redpitaya_send_command( SOCKET socket, uint32_t command )
     throw std::runtime_error( message.str() );
   }
 }
+
+bool redpitaya_is_transient_error()
+{
+#if defined(_WIN32)
+  int err = WSAGetLastError();
+  return WSAEWOULDBLOCK == err || WSAEINTR == err || WSAETIMEDOUT == err;
+#else
+  return EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno;
+#endif
+}
+
+void redpitaya_set_rcvbuf( SOCKET socket, int size )
+{
+  int actual = 0;
+  socklen_t optlen = sizeof(actual);
+
+  /* an explicit size turns off the Linux receive buffer autotuning, which
+   * is why rcvbuf=0 leaves the choice to the kernel */
+  setsockopt( socket, SOL_SOCKET, SO_RCVBUF, (char *)&size, sizeof(size) );
+  getsockopt( socket, SOL_SOCKET, SO_RCVBUF, (char *)&actual, &optlen );
+#if defined(__linux__)
+  actual /= 2; /* the kernel doubles the size for its own overhead */
+#endif
+
+  if ( actual < size )
+    std::cerr << "Red Pitaya receive buffer limited to " << actual
+              << " bytes, consider raising net.core.rmem_max" << std::endl;
+}
@@ -52,4 +52,10 @@
 
 void redpitaya_send_command( SOCKET socket, uint32_t command );
 
+/* the last socket call timed out or was interrupted, worth another try */
+bool redpitaya_is_transient_error();
+
+/* must come before connect(), the TCP window scale is fixed then */
+void redpitaya_set_rcvbuf( SOCKET socket, int size );
+
 #endif // REDPITAYA_COMMON_H
@@ -23,6 +23,14 @@
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
+#include <iostream>
+
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#endif
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
@@ -36,6 +44,10 @@
 
 using namespace boost::assign;
 
+#define WRITE_SIZE   (64*1024)     /* what the writer waits to collect */
+#define TX_WAIT_USEC 100000        /* select() and ring timeout, bounds stop() */
+#define DRAIN_USEC   1000000       /* how long stop() lets the writer flush */
+
 redpitaya_sink_c_sptr make_redpitaya_sink_c(const std::string &args)
 {
   return gnuradio::get_initial_sptr(new redpitaya_sink_c(args));
@@ -44,7 +56,12 @@ redpitaya_sink_c_sptr make_redpitaya_sink_c(const std::string &args)
 redpitaya_sink_c::redpitaya_sink_c(const std::string &args) :
   gr::sync_block("redpitaya_sink_c",
                  gr::io_signature::make(1, 1, sizeof(gr_complex)),
-                 gr::io_signature::make(0, 0, 0))
+                 gr::io_signature::make(0, 0, 0)),
+  _latency_ms(100),
+  _ring_buf(NULL),
+  _writing(false),
+  _failed(false),
+  _underruns(0)
 {
   std::string host = "192.168.1.100";
   std::stringstream message;
@@ -78,6 +95,12 @@ redpitaya_sink_c::redpitaya_sink_c(const std::string &args) :
   if ( dict.count("ptt") )
     ptt = boost::lexical_cast< unsigned short >( dict["ptt"] );
 
+  if ( dict.count( "tx_latency_ms" ) )
+    _latency_ms = boost::lexical_cast< int >( dict["tx_latency_ms"] );
+
+  if ( _latency_ms <= 0 )
+    _latency_ms = 100;
+
   if ( !host.length() )
     host = "192.168.1.100";
 
@@ -112,6 +135,10 @@ redpitaya_sink_c::redpitaya_sink_c(const std::string &args) :
 
 redpitaya_sink_c::~redpitaya_sink_c()
 {
+  stop();
+
+  delete [] _ring_buf;
+
 #if defined(_WIN32)
   ::closesocket( _sockets[1] );
   ::closesocket( _sockets[0] );
@@ -122,28 +149,204 @@ redpitaya_sink_c::~redpitaya_sink_c()
 #endif
 }
 
+bool redpitaya_sink_c::start()
+{
+  /* latency_ms of cf32 at the DAC rate, with a floor for the slow rates */
+  size_t size = size_t( _rate * sizeof(gr_complex) * _latency_ms / 1000 );
+  size = std::max( size, size_t(8192) );
+  size -= size % sizeof(gr_complex);
+
+  if ( !_ring_buf || size != _ring.capacity() )
+  {
+    delete [] _ring_buf;
+    _ring_buf = new unsigned char[size];
+  }
+
+  _ring.reset( size );
+  _failed = false;
+  _underruns = 0;
+
+  _writing = true;
+  _thread = gr::thread::thread( boost::bind( &redpitaya_sink_c::writer_task, this ) );
+
+  return true;
+}
+
+bool redpitaya_sink_c::stop()
+{
+  if ( !_thread.joinable() )
+    return true;
+
+  /* the writer sends what is queued before it leaves */
+  _writing = false;
+  _ring.stop();
+  _thread.join();
+
+  if ( _underruns )
+    std::cerr << "Red Pitaya: " << _underruns << " underruns" << std::endl;
+
+  return true;
+}
+
+/*
+ * Sends the queued samples in big batches, so the scheduler thread never
+ * blocks on the socket and the server gets few large segments instead of
+ * one small write per work() call. The writer waits until WRITE_SIZE bytes
+ * are queued or a quarter of the latency budget has passed, then hands
+ * it over a batch per call, both segments around the wrap together. While
+ * more than a batch is queued the calls carry MSG_MORE, so the kernel
+ * fills whole segments and only pushes once the backlog is gone.
+ *
+ * The server cannot tell us when its DAC runs dry, so we keep count of
+ * what was sent since the stream (re)started. If the ring is empty and
+ * that falls behind what the server has played out at the sample rate,
+ * it must have underrun.
+ */
+void redpitaya_sink_c::writer_task()
+{
+  using namespace boost::posix_time;
+
+  SOCKET sock = _sockets[1];
+  size_t batch = std::min( size_t(WRITE_SIZE), _ring.capacity() / 2 );
+  unsigned int flush_usec = std::max( 1000, _latency_ms * 1000 / 4 );
+  ptime drain_deadline;
+  ptime stream_start;
+  uint64_t sent_bytes = 0;
+  bool streaming = false;
+
+  while ( true )
+  {
+    if ( !_writing )
+    {
+      if ( drain_deadline.is_not_a_date_time() )
+        drain_deadline = microsec_clock::universal_time() + microseconds( DRAIN_USEC );
+
+      if ( !_ring.size() || microsec_clock::universal_time() > drain_deadline )
+        break;
+    }
+    else if ( _ring.size() < batch )
+    {
+      _ring.wait( batch, 0, flush_usec );
+    }
+
+    size_t nbytes = _ring.size();
+
+    if ( !nbytes )
+    {
+      if ( streaming )
+      {
+        double played = ( microsec_clock::universal_time() - stream_start )
+                        .total_microseconds() * 1e-6 * _rate;
+
+        if ( sent_bytes / sizeof(gr_complex) < played )
+        {
+          _underruns++;
+          streaming = false;
+        }
+      }
+
+      continue;
+    }
+
+    fd_set writefds;
+    FD_ZERO( &writefds );
+    FD_SET( sock, &writefds );
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = TX_WAIT_USEC;
+
+    int ret = select( sock + 1, NULL, &writefds, NULL, &timeout );
+    if ( 0 == ret || ( ret < 0 && redpitaya_is_transient_error() ) )
+      continue;
+
+    if ( ret < 0 )
+      break;
+
+#if !defined(_WIN32)
+    int flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+#if defined(MSG_MORE)
+    if ( nbytes > batch )
+    {
+      nbytes = batch;
+      flags |= MSG_MORE;
+    }
+#endif
+#endif
+
+    size_t head = _ring.head();
+    size_t first = std::min( nbytes, _ring.capacity() - head );
+
+#if defined(_WIN32)
+    int size = ::send( sock, (char *)_ring_buf + head, (int)first, 0 );
+#else
+    struct iovec iov[2];
+    iov[0].iov_base = _ring_buf + head;
+    iov[0].iov_len = first;
+    iov[1].iov_base = _ring_buf;
+    iov[1].iov_len = nbytes - first;
+
+    struct msghdr msg;
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = iov;
+    msg.msg_iovlen = nbytes > first ? 2 : 1;
+
+    ssize_t size = ::sendmsg( sock, &msg, flags );
+#endif
+
+    if ( size < 0 && redpitaya_is_transient_error() )
+      continue;
+
+    if ( size <= 0 )
+      break;
+
+    if ( !streaming )
+    {
+      stream_start = microsec_clock::universal_time();
+      sent_bytes = 0;
+      streaming = true;
+    }
+
+    sent_bytes += size;
+    _ring.pop( size );
+  }
+
+  if ( _writing )
+    _failed = true;
+
+  _ring.stop();
+}
+
 int redpitaya_sink_c::work( int noutput_items,
                             gr_vector_const_void_star &input_items,
                             gr_vector_void_star &output_items )
 {
   const gr_complex *in = (const gr_complex *)input_items[0];
+  const size_t sample_size = sizeof(gr_complex);
 
-#if defined(_WIN32)
-  int size;
-  int total = sizeof(gr_complex) * noutput_items;
-  size = ::send( _sockets[1], (char *)in, total, 0 );
-#else
-  ssize_t size;
-  ssize_t total = sizeof(gr_complex) * noutput_items;
-  size = ::send( _sockets[1], in, total, MSG_NOSIGNAL );
-#endif
+  /* a full ring means we are a whole latency budget ahead, so wait */
+  if ( _ring.space() < sample_size )
+    _ring.wait_space( sample_size, 0, TX_WAIT_USEC );
 
-  if ( size != total )
+  if ( _failed )
     throw std::runtime_error( "Sending samples failed." );
 
-  consume(0, noutput_items);
+  size_t space = _ring.space();
+  size_t nbytes = std::min( size_t(noutput_items) * sample_size,
+                            space - space % sample_size );
 
-  return 0;
+  if ( !nbytes )
+    return 0;
+
+  size_t tail = _ring.tail();
+  size_t first = std::min( nbytes, _ring.capacity() - tail );
+
+  memcpy( _ring_buf + tail, in, first );
+  memcpy( _ring_buf, (const unsigned char *)in + first, nbytes - first );
+
+  _ring.push( nbytes );
+
+  return nbytes / sample_size;
 }
 
 std::string redpitaya_sink_c::name()
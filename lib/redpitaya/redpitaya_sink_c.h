@@ -22,8 +22,12 @@
 #define REDPITAYA_SINK_C_H
 
 #include <gnuradio/sync_block.h>
+#include <gnuradio/thread/thread.h>
+
+#include <boost/atomic.hpp>
 
 #include "sink_iface.h"
+#include "spsc_ring.h"
 
 #include "redpitaya_common.h"
 
@@ -45,6 +49,9 @@ private:
 public:
   ~redpitaya_sink_c();
 
+  bool start();
+  bool stop();
+
   int work( int noutput_items,
             gr_vector_const_void_star &input_items,
             gr_vector_void_star &output_items );
@@ -77,9 +84,26 @@ public:
   std::string set_antenna( const std::string & antenna, size_t chan = 0 );
   std::string get_antenna( size_t chan = 0 );
 
+  /* times the server ran out of samples, as far as we can tell */
+  unsigned long get_underruns( size_t mboard = 0 ) { return _underruns; }
+
 private:
+  void writer_task();
+
   double _freq, _rate, _corr;
   SOCKET _sockets[2];
+
+  int _latency_ms;               /* sizes the ring at start() */
+
+  /* cf32 bytes for the writer thread, one byte per slot */
+  unsigned char *_ring_buf;
+  spsc_ring _ring;
+
+  gr::thread::thread _thread;
+  boost::atomic<bool> _writing;
+  boost::atomic<bool> _failed;   /* the data connection is gone */
+
+  boost::atomic<unsigned long> _underruns;
 };
 
 #endif // REDPITAYA_SINK_C_H
@@ -23,6 +23,10 @@
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
+#include <iostream>
+
+#include <string.h>
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
@@ -36,6 +40,10 @@
 
 using namespace boost::assign;
 
+#define READ_SIZE    (256*1024)    /* most we ask recv() for at once */
+#define RX_WAIT_USEC 100000        /* select() and ring timeout, bounds stop() */
+#define MAX_RATE     1250000       /* the fastest rate the server offers */
+
 redpitaya_source_c_sptr make_redpitaya_source_c(const std::string &args)
 {
   return gnuradio::get_initial_sptr(new redpitaya_source_c(args));
@@ -44,13 +52,23 @@ redpitaya_source_c_sptr make_redpitaya_source_c(const std::string &args)
 redpitaya_source_c::redpitaya_source_c(const std::string &args) :
   gr::sync_block("redpitaya_source_c",
                  gr::io_signature::make(0, 0, 0),
-                 gr::io_signature::make(1, 1, sizeof(gr_complex)))
+                 gr::io_signature::make(1, 1, sizeof(gr_complex))),
+  _readahead_ms(250),
+  _ring_buf(NULL),
+  _drop_buf(NULL),
+  _reading(false),
+  _failed(false),
+  _starved(false),
+  _overruns(0),
+  _underruns(0),
+  _dropped(0)
 {
   std::string host = "192.168.1.100";
   std::stringstream message;
   unsigned short port = 1001;
   struct sockaddr_in addr;
   uint32_t command;
+  int rcvbuf = 4*1024*1024;
 
 #if defined(_WIN32)
   WSADATA wsaData;
@@ -75,6 +93,15 @@ redpitaya_source_c::redpitaya_source_c(const std::string &args) :
       port = boost::lexical_cast< unsigned short >( tokens[1] );
   }
 
+  if ( dict.count( "readahead_ms" ) )
+    _readahead_ms = boost::lexical_cast< int >( dict["readahead_ms"] );
+
+  if ( dict.count( "rcvbuf" ) )
+    rcvbuf = boost::lexical_cast< int >( dict["rcvbuf"] );
+
+  if ( _readahead_ms <= 0 )
+    _readahead_ms = 250;
+
   if ( !host.length() )
     host = "192.168.1.100";
 
@@ -91,6 +118,10 @@ redpitaya_source_c::redpitaya_source_c(const std::string &args) :
     inet_pton( AF_INET, host.c_str(), &addr.sin_addr );
     addr.sin_port = htons( port );
 
+    /* only the second connection carries samples */
+    if ( 1 == i && rcvbuf > 0 )
+      redpitaya_set_rcvbuf( _sockets[i], rcvbuf );
+
     if ( ::connect( _sockets[i], (struct sockaddr *)&addr, sizeof(addr) ) < 0 )
     {
       message << "Could not connect to " << host << ":" << port << ".";
@@ -100,10 +131,17 @@ redpitaya_source_c::redpitaya_source_c(const std::string &args) :
     command = i;
     redpitaya_send_command( _sockets[i], command );
   }
+
+  _drop_buf = new unsigned char[READ_SIZE];
 }
 
 redpitaya_source_c::~redpitaya_source_c()
 {
+  stop();
+
+  delete [] _ring_buf;
+  delete [] _drop_buf;
+
 #if defined(_WIN32)
   ::closesocket( _sockets[1] );
   ::closesocket( _sockets[0] );
@@ -114,26 +152,171 @@ redpitaya_source_c::~redpitaya_source_c()
 #endif
 }
 
+bool redpitaya_source_c::start()
+{
+  double rate = _rate > 0 ? _rate : MAX_RATE;
+
+  /* the server sends cf32, a multiple of it keeps work()'s copies simple */
+  size_t size = size_t( rate * sizeof(gr_complex) * _readahead_ms / 1000 );
+  size = std::max( size, size_t(READ_SIZE) * 2 );
+  size -= size % sizeof(gr_complex);
+
+  if ( !_ring_buf || size != _ring.capacity() )
+  {
+    delete [] _ring_buf;
+    _ring_buf = new unsigned char[size];
+  }
+
+  _ring.reset( size );
+  _starved = true; /* no underrun before the first samples arrived */
+
+  _reading = true;
+  _thread = gr::thread::thread( boost::bind( &redpitaya_source_c::reader_task, this ) );
+
+  return true;
+}
+
+bool redpitaya_source_c::stop()
+{
+  if ( !_thread.joinable() )
+    return true;
+
+  _reading = false;
+  _ring.stop();
+  _thread.join();
+
+  if ( _overruns || _underruns )
+    std::cerr << "Red Pitaya: " << _overruns << " overruns, "
+              << _underruns << " underruns, "
+              << _dropped << " samples dropped" << std::endl;
+
+  return true;
+}
+
+/*
+ * The server pushes cf32 at the sample rate and has no flow control of its
+ * own, so this thread keeps reading even when work() falls behind. What
+ * does not fit into the ring goes to _drop_buf and is counted, and after
+ * such a gap we resync on the 8 byte sample boundary before filling the
+ * ring again.
+ */
+void redpitaya_source_c::reader_task()
+{
+  const size_t sample_size = sizeof(gr_complex);
+  SOCKET sock = _sockets[1];
+  uint64_t dropped_bytes = 0;
+  bool overrun = false;
+
+  while ( _reading )
+  {
+    fd_set readfds;
+    FD_ZERO( &readfds );
+    FD_SET( sock, &readfds );
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = RX_WAIT_USEC;
+
+    int ret = select( sock + 1, &readfds, NULL, NULL, &timeout );
+    if ( 0 == ret || ( ret < 0 && redpitaya_is_transient_error() ) )
+      continue;
+
+    if ( ret < 0 )
+      break;
+
+    size_t space = _ring.space();
+    unsigned char *dst = _drop_buf;
+    size_t len = READ_SIZE;
+    bool drop = true;
+
+    if ( space && ( dropped_bytes % sample_size ) )
+    {
+      len = sample_size - dropped_bytes % sample_size; /* the rest of a sample */
+    }
+    else if ( space )
+    {
+      size_t tail = _ring.tail();
+      dst = _ring_buf + tail;
+      len = std::min( std::min( space, _ring.capacity() - tail ), size_t(READ_SIZE) );
+      drop = false;
+    }
+
+#if defined(_WIN32)
+    int size = ::recv( sock, (char *)dst, (int)len, 0 );
+#else
+    ssize_t size = ::recv( sock, dst, len, 0 );
+#endif
+
+    if ( size < 0 && redpitaya_is_transient_error() )
+      continue;
+
+    if ( size <= 0 )
+      break;
+
+    if ( drop )
+    {
+      if ( !overrun )
+        _overruns++;
+      overrun = true;
+
+      _dropped += ( dropped_bytes + size ) / sample_size - dropped_bytes / sample_size;
+      dropped_bytes += size;
+    }
+    else
+    {
+      overrun = false;
+      _ring.push( size );
+    }
+  }
+
+  if ( _reading )
+    _failed = true;
+
+  _ring.stop();
+}
+
 int redpitaya_source_c::work( int noutput_items,
                               gr_vector_const_void_star &input_items,
                               gr_vector_void_star &output_items )
 {
   gr_complex *out = (gr_complex *)output_items[0];
+  const size_t sample_size = sizeof(gr_complex);
 
-#if defined(_WIN32)
-  int size;
-  int total = sizeof(gr_complex) * noutput_items;
-  size = ::recv( _sockets[1], (char *)out, total, MSG_WAITALL );
-#else
-  ssize_t size;
-  ssize_t total = sizeof(gr_complex) * noutput_items;
-  size = ::recv( _sockets[1], out, total, MSG_WAITALL );
-#endif
+  if ( _ring.size() < sample_size )
+  {
+    if ( _failed )
+      throw std::runtime_error( "Receiving samples failed." );
+
+    _ring.wait( sample_size, 0, RX_WAIT_USEC );
+
+    /* catching up with the network is fine, a stalled stream is not */
+    if ( _ring.size() < sample_size )
+    {
+      if ( !_starved )
+        _underruns++;
+      _starved = true;
+
+      return 0;
+    }
+  }
+
+  /* never wait for more than the reader has, and never hand out half a cf32 */
+  size_t nbytes = _ring.size();
+  nbytes = std::min( size_t(noutput_items) * sample_size, nbytes - nbytes % sample_size );
+
+  if ( !nbytes )
+    return 0;
+
+  size_t head = _ring.head();
+  size_t first = std::min( nbytes, _ring.capacity() - head );
 
-  if ( size != total )
-    throw std::runtime_error( "Receiving samples failed." );
+  memcpy( (unsigned char *)out, _ring_buf + head, first );
+  memcpy( (unsigned char *)out + first, _ring_buf, nbytes - first );
 
-  return noutput_items;
+  _ring.pop( nbytes );
+  _starved = false;
+
+  return nbytes / sample_size;
 }
 
 std::string redpitaya_source_c::name()
@@ -285,3 +468,8 @@ std::string redpitaya_source_c::get_antenna( size_t chan )
 {
   return "RX";
 }
+
+uint64_t redpitaya_source_c::get_dropped_samples( size_t mboard )
+{
+  return _dropped;
+}
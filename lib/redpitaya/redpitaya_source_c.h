@@ -22,8 +22,12 @@
 #define REDPITAYA_SOURCE_C_H
 
 #include <gnuradio/sync_block.h>
+#include <gnuradio/thread/thread.h>
+
+#include <boost/atomic.hpp>
 
 #include "source_iface.h"
+#include "spsc_ring.h"
 
 #include "redpitaya_common.h"
 
@@ -45,6 +49,9 @@ private:
 public:
   ~redpitaya_source_c();
 
+  bool start();
+  bool stop();
+
   int work( int noutput_items,
             gr_vector_const_void_star &input_items,
             gr_vector_void_star &output_items );
@@ -77,9 +84,33 @@ public:
   std::string set_antenna( const std::string & antenna, size_t chan = 0 );
   std::string get_antenna( size_t chan = 0 );
 
+  uint64_t get_dropped_samples( size_t mboard = 0 );
+
+  /* times the ring ran full, and times the stream stalled for 100 ms */
+  unsigned long get_overruns( size_t mboard = 0 ) { return _overruns; }
+  unsigned long get_underruns( size_t mboard = 0 ) { return _underruns; }
+
 private:
+  void reader_task();
+
   double _freq, _rate, _corr;
   SOCKET _sockets[2];
+
+  int _readahead_ms;             /* sizes the ring at start() */
+
+  /* raw cf32 bytes from the reader thread, one byte per slot */
+  unsigned char *_ring_buf;
+  spsc_ring _ring;
+  unsigned char *_drop_buf;      /* receives what does not fit */
+
+  gr::thread::thread _thread;
+  boost::atomic<bool> _reading;
+  boost::atomic<bool> _failed;   /* the data connection is gone */
+  bool _starved;                 /* no samples since the last stall */
+
+  boost::atomic<unsigned long> _overruns;
+  boost::atomic<unsigned long> _underruns;
+  boost::atomic<uint64_t> _dropped;
 };
 
 #endif // REDPITAYA_SOURCE_C_H
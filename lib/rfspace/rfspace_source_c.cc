@@ -59,8 +59,13 @@
 #endif
 
 #include <gnuradio/io_signature.h>
+#ifndef ENABLE_RUNTIME
+#include <gnuradio/tags.h>
+#include <pmt/pmt.h>
+#endif
 
 #include "arg_helpers.h"
+#include "convert.h"
 #include "rfspace_source_c.h"
 
 using namespace boost::assign;
@@ -71,6 +76,25 @@ using boost::asio::deadline_timer;
 #define DEFAULT_HOST  "127.0.0.1" /* We assume a running "siqs" from CuteSDR project */
 #define DEFAULT_PORT  50000
 
+/*
+ * The data items are 1028 bytes at most in 16 bit and 1444 bytes in 24 bit
+ * mode. 4096 slots hold about half a second of the fastest NetSDR stream.
+ */
+#define UDP_SLOT_SIZE 2048
+#define UDP_SLOTS     4096
+#define UDP_BATCH     64              /* datagrams per recvmmsg() call */
+#define UDP_RCVBUF    (8*1024*1024)
+
+/* about a second of SDR-IQ samples, read() picks up to 8 frames at once */
+#define USB_FIFO_SIZE 200000
+#define USB_READ_SIZE (64*1024)
+
+#define RX_WAIT_USEC  100000
+
+#ifndef ENABLE_RUNTIME
+static const pmt::pmt_t DROPPED_KEY = pmt::string_to_symbol("rx_dropped");
+#endif
+
 /*
  * Create a new instance of rfspace_source_c and return
  * a boost shared_ptr.  This is effectively the public constructor.
@@ -102,6 +126,8 @@ rfspace_source_c::rfspace_source_c (const std::string &args)
                     gr::io_signature::make (MIN_IN, MAX_IN, sizeof (gr_complex)),
                     gr::io_signature::make (MIN_OUT, MAX_OUT, sizeof (gr_complex))),
     _radio(RADIO_UNKNOWN),
+    _gap(GAP_DROP),
+    _sample_bits(16),
 #ifdef USE_ASIO
     _io_service(),
     _resolver(_io_service),
@@ -118,7 +144,17 @@ rfspace_source_c::rfspace_source_c (const std::string &args)
     _nchan(1),
     _sample_rate(NAN),
     _bandwidth(0.0f),
-    _fifo(NULL)
+    _run_usb_read_task(false),
+    _fifo(NULL),
+    _udp_buf(NULL),
+    _udp_offset(0),
+    _udp_checked(false),
+    _gap_items(0),
+    _resync(true),
+    _lost_packets(0),
+    _lost_samples(0),
+    _run_udp_read_task(false),
+    _flush(false)
 {
   std::string host = "";
   unsigned short port = 0;
@@ -182,6 +218,41 @@ rfspace_source_c::rfspace_source_c (const std::string &args)
   if ( _nchan < 1 || _nchan > 2 )
     throw std::runtime_error("Number of channels (nchan) must be 1 or 2");
 
+  if ( dict.count("format") )
+  {
+    std::string format = dict["format"];
+
+    if ( "16" == format )
+      _sample_bits = 16;
+    else if ( "24" == format )
+      _sample_bits = 24;
+    else
+      throw std::runtime_error("Sample format (format) must be 16 or 24");
+  }
+
+  if ( dict.count("gap") )
+  {
+    std::string gap = dict["gap"];
+
+    if ( "zero" == gap )
+      _gap = GAP_ZERO;
+    else if ( "drop" == gap )
+      _gap = GAP_DROP;
+    else if ( "tag" == gap )
+      _gap = GAP_TAG;
+    else
+      throw std::runtime_error("Gap mode (gap) must be zero, drop or tag");
+
+#ifdef ENABLE_RUNTIME
+    if ( GAP_TAG == _gap )
+    {
+      std::cerr << "Stream tags are not supported by this runtime, "
+                << "gap=tag only counts the losses" << std::endl;
+      _gap = GAP_DROP;
+    }
+#endif
+  }
+
   if ( ! host.length() )
     host = DEFAULT_HOST;
 
@@ -225,9 +296,8 @@ rfspace_source_c::rfspace_source_c (const std::string &args)
 
     _radio = RFSPACE_SDR_IQ; /* legitimate assumption */
 
-    _fifo = new boost::circular_buffer<gr_complex>( 200000 );
-    if ( ! _fifo )
-      throw std::runtime_error( "Failed to allocate sample FIFO" );
+    _fifo = new gr_complex[ USB_FIFO_SIZE ];
+    _fifo_ring.reset( USB_FIFO_SIZE );
 
     _run_usb_read_task = true;
 
@@ -261,6 +331,12 @@ rfspace_source_c::rfspace_source_c (const std::string &args)
     _u.set_option(udp::socket::reuse_address(true));
     _t.set_option(udp::socket::reuse_address(true));
 
+    _u.set_option(udp::socket::receive_buffer_size(UDP_RCVBUF), ec);
+
+    udp::socket::receive_buffer_size rcvbuf;
+    _u.get_option(rcvbuf, ec);
+    int rcvbuf_size = rcvbuf.value();
+
 #else
 
     if ( (_tcp = socket(AF_INET, SOCK_STREAM, 0) ) < 0)
@@ -339,8 +415,35 @@ rfspace_source_c::rfspace_source_c (const std::string &args)
       throw std::runtime_error("Bind of UDP socket failed: " + std::string(strerror(errno)));
     }
 
+    /* give the kernel room to queue datagrams while we are descheduled */
+    sockoptval = UDP_RCVBUF;
+    setsockopt(_udp, SOL_SOCKET, SO_RCVBUF, &sockoptval, sizeof(int));
+
+    int rcvbuf_size = 0;
+    socklen_t optlen = sizeof(rcvbuf_size);
+    getsockopt(_udp, SOL_SOCKET, SO_RCVBUF, &rcvbuf_size, &optlen);
+
+    /* lets the receive thread look at its stop flag once in a while */
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = RX_WAIT_USEC;
+    setsockopt(_udp, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
 #endif
 
+    /* Linux reports twice the requested size, other systems don't */
+    if ( rcvbuf_size < UDP_RCVBUF / 2 )
+      std::cerr << "UDP receive buffer limited to " << rcvbuf_size
+                << " bytes, consider raising net.core.rmem_max" << std::endl;
+
+    _udp_buf = new unsigned char[ UDP_SLOTS * UDP_SLOT_SIZE ];
+    _udp_len.resize( UDP_SLOTS );
+    _udp_ring.reset( UDP_SLOTS );
+
+    _run_udp_read_task = true;
+
+    _udp_thread = gr::thread::thread( boost::bind(&rfspace_source_c::udp_read_task, this) );
+
   }
 
   /* request & print device information */
@@ -430,6 +533,12 @@ rfspace_source_c::rfspace_source_c (const std::string &args)
 
   std::cerr << std::endl;
 
+  if ( RFSPACE_SDR_IQ == _radio && 24 == _sample_bits )
+  {
+    std::cerr << "SDR-IQ supports 16 bit samples only." << std::endl;
+    _sample_bits = 16;
+  }
+
   if ( RFSPACE_NETSDR == _radio )
   {
     /* NETSDR 4.2.2 Receiver Channel Setup */
@@ -493,25 +602,37 @@ rfspace_source_c::rfspace_source_c (const std::string &args)
  */
 rfspace_source_c::~rfspace_source_c ()
 {
+  if ( _udp_thread.joinable() )
+  {
+    _run_udp_read_task = false;
+    _udp_ring.stop();
+#ifdef USE_ASIO
+    boost::system::error_code ec;
+    _u.shutdown(udp::socket::shutdown_receive, ec);
+#endif
+    _udp_thread.join();
+  }
+
+  delete[] _udp_buf;
+  _udp_buf = NULL;
+
 #ifndef USE_ASIO
   close(_tcp);
   close(_udp);
 #endif
 
-  if ( RFSPACE_SDR_IQ == _radio )
+  if ( _thread.joinable() )
   {
     _run_usb_read_task = false;
+    _fifo_ring.stop();
 
     _thread.join();
   }
 
   close(_usb);
 
-  if ( _fifo )
-  {
-    delete _fifo;
-    _fifo = NULL;
-  }
+  delete[] _fifo;
+  _fifo = NULL;
 }
 
 void rfspace_source_c::apply_channel( unsigned char *cmd, size_t chan )
@@ -566,13 +687,18 @@ bool rfspace_source_c::transaction( const unsigned char *cmd, size_t size,
   printf("\n");
 #endif
 
-  if ( RFSPACE_SDR_IQ == _radio )
+  if ( -1 != _usb )
   {
+    /* locked before the write, the response may arrive right away */
+    boost::unique_lock<boost::mutex> lock(_resp_lock);
+    _resp.clear();
+
     if ( write(_usb, cmd, size) != (int)size )
       return false;
 
-    boost::unique_lock<boost::mutex> lock(_resp_lock);
-    _resp_avail.wait(lock);
+    while ( _resp.empty() )
+      if ( ! _resp_avail.timed_wait( lock, boost::posix_time::seconds(1) ) )
+        return false;
 
     rx_bytes = _resp.size();
     memcpy( data, _resp.data(), rx_bytes );
@@ -619,114 +745,190 @@ bool rfspace_source_c::transaction( const unsigned char *cmd, size_t size,
   return true;
 }
 
-static size_t read_bytes( int fd, char *data, size_t size, bool &run )
+/*
+ * Picks up whatever the serial driver has buffered, up to USB_READ_SIZE
+ * bytes, and splits it into messages. Sample data items are converted
+ * straight into the FIFO, anything else is a response to transaction().
+ */
+void rfspace_source_c::usb_read_task()
 {
+  std::vector< unsigned char > data( USB_READ_SIZE );
   size_t nbytes = 0;
 
-  while ( nbytes < size && run )
-  {
-    int nread = read( fd, &data[nbytes], 1 );
-
-    if ( nread == 0 )
-      continue;   
+  if ( -1 == _usb )
+    return;
 
+  while ( _run_usb_read_task )
+  {
+    /* returns after VTIME without data, see the termios setup */
+    ssize_t nread = read( _usb, &data[nbytes], data.size() - nbytes );
     if ( nread < 0 )
+    {
+      if ( EINTR == errno || EAGAIN == errno )
+        continue;
+
+      std::cerr << "read failed: " << strerror(errno) << std::endl;
       break;
+    }
 
-    nbytes++;
-  }
+    nbytes += nread;
 
-  return nbytes;
-}
+    size_t pos = 0;
 
-void rfspace_source_c::usb_read_task()
-{
-  char data[1024*10];
-  size_t n_avail, to_copy;
+    while ( nbytes - pos >= 2 )
+    {
+      unsigned char *msg = &data[pos];
+      size_t length = ((msg[1] << 8) | msg[0]) & 0x1fff;
 
-  if ( -1 == _usb )
-    return;
+      if ( 0 == length ) /* SDR-IQ 5.4.1 Output Data Item 0 */
+        length = 1024*8 + 2;
 
-  while ( _run_usb_read_task )
-  {
-    size_t nbytes = read_bytes( _usb, data, 2, _run_usb_read_task );
-    if ( nbytes != 2 )
-      continue;
+      if ( length <= 2 )
+      {
+        pos += 2;
+        continue;
+      }
 
-    size_t length = ((data[1] << 8) | data[0]) & 0x1fff;
+      if ( nbytes - pos < length ) /* the rest comes with the next read */
+        break;
 
-    if ( 0 == length ) /* SDR-IQ 5.4.1 Output Data Item 0 */
-      length = 1024*8 + 2;
+      pos += length;
 
-    if ( length <= 2 )
-      continue;
+      if ( 1024*8 + 2 == length )
+      {
+        /* push samples into the fifo, in up to two segments */
 
-    length -= 2; /* subtract header */
+        size_t num_samples = 1024*2;
+        size_t to_copy = std::min( num_samples, _fifo_ring.space() );
+        size_t tail = _fifo_ring.tail();
+        size_t first = std::min( to_copy, _fifo_ring.capacity() - tail );
 
-    if ( length > sizeof(data) - 2 )
-    {
-      _run_usb_read_task = false;
+        convert_cs16_to_cf32( msg + 2, _fifo + tail, first, 1.0f/32768.0f );
+        convert_cs16_to_cf32( msg + 2 + first * 4, _fifo, to_copy - first, 1.0f/32768.0f );
 
-      continue;
-    }
+        if ( to_copy )
+          _fifo_ring.push( to_copy );
 
-    nbytes = read_bytes( _usb, data + 2, length, _run_usb_read_task );
-    if ( nbytes != length )
-      continue;
+        /* Indicate overrun, if neccesary */
+        if ( to_copy < num_samples )
+          std::cerr << "O" << std::flush;
+      }
+      else
+      {
+        /* copy response & signal transaction */
 
-    if ( 1024*8 == length )
-    {
-      /* push samples into the fifo */
+        _resp_lock.lock();
 
-      _fifo_lock.lock();
+        _resp.clear();
+        _resp.resize( length );
+        memcpy( _resp.data(), msg, length );
 
-      size_t num_samples = length / 4;
-      n_avail = _fifo->capacity() - _fifo->size();
-      to_copy = (n_avail < num_samples ? n_avail : num_samples);
+        _resp_lock.unlock();
 
-      #define SCALE_16  (1.0f/32768.0f)
+        _resp_avail.notify_one();
+      }
+    }
 
-      int16_t *sample = (int16_t *)(data + 2);
+    /* move an incomplete message to the front */
+    memmove( &data[0], &data[pos], nbytes - pos );
+    nbytes -= pos;
+  }
 
-      for ( size_t i = 0; i < to_copy; i++ )
-      {
-        /* Push sample to the fifo */
-        _fifo->push_back( gr_complex( *(sample+0) * SCALE_16,
-                                      *(sample+1) * SCALE_16 ) );
+  _run_usb_read_task = false;
+  _fifo_ring.stop();
+}
 
-        /* offset to the next I+Q sample */
-        sample += 2;
-      }
+/*
+ * Receives the I/Q data items into the datagram ring. On Linux recvmmsg()
+ * collects whatever the kernel has queued, up to UDP_BATCH datagrams, in
+ * one system call. Once the ring is full the socket buffer takes over and
+ * the loss shows up as a sequence gap in work().
+ */
+void rfspace_source_c::udp_read_task()
+{
+#if defined(__linux__) && !defined(USE_ASIO)
+  struct mmsghdr msgs[UDP_BATCH];
+  struct iovec iovs[UDP_BATCH];
 
-      #undef SCALE_16
+  memset(msgs, 0, sizeof(msgs));
+#endif
 
-      _fifo_lock.unlock();
+  while ( _run_udp_read_task )
+  {
+    size_t space = _udp_ring.space();
 
-      /* We have made some new samples available to the consumer in work() */
-      if (to_copy) {
-//        std::cerr << "+" << std::flush;
-        _samp_avail.notify_one();
-      }
+    if ( ! space )
+    {
+      _udp_ring.wait_space( 1, 0, RX_WAIT_USEC );
+      continue;
+    }
+
+    /* a batch never wraps around the end of the ring */
+    size_t tail = _udp_ring.tail();
+    size_t count = std::min( space, _udp_ring.capacity() - tail );
+    count = std::min( count, size_t(UDP_BATCH) );
 
-      /* Indicate overrun, if neccesary */
-      if (to_copy < num_samples)
-        std::cerr << "O" << std::flush;
+    unsigned char *slot = _udp_buf + tail * UDP_SLOT_SIZE;
+    size_t received = 0;
+
+#ifdef USE_ASIO
+    boost::system::error_code ec;
+    udp::endpoint ep;
+    size_t rx_bytes = _u.receive_from( boost::asio::buffer(slot, UDP_SLOT_SIZE), ep, 0, ec );
+    if ( ec )
+    {
+      if ( _run_udp_read_task )
+        std::cerr << "receive_from failed: " << ec.message() << std::endl;
+      break;
     }
-    else
+
+    _udp_len[tail] = rx_bytes;
+    received = 1;
+#elif defined(__linux__)
+    for ( size_t i = 0; i < count; i++ )
     {
-      /* copy response & signal transaction */
+      iovs[i].iov_base = slot + i * UDP_SLOT_SIZE;
+      iovs[i].iov_len = UDP_SLOT_SIZE;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-      _resp_lock.lock();
+    /* blocks for the first datagram only, up to SO_RCVTIMEO */
+    int n = recvmmsg(_udp, msgs, count, MSG_WAITFORONE, NULL);
+    if ( n < 0 )
+    {
+      if ( EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno )
+        continue;
+
+      std::cerr << "recvmmsg failed: " << strerror(errno) << std::endl;
+      break;
+    }
 
-      _resp.clear();
-      _resp.resize( length + 2 );
-      memcpy( _resp.data(), data, length + 2 );
+    for ( int i = 0; i < n; i++ )
+      _udp_len[tail + i] = msgs[i].msg_len;
 
-      _resp_lock.unlock();
+    received = n;
+#else
+    ssize_t rx_bytes = recv(_udp, slot, UDP_SLOT_SIZE, 0);
+    if ( rx_bytes < 0 )
+    {
+      if ( EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno )
+        continue;
 
-      _resp_avail.notify_one();
+      std::cerr << "recv failed: " << strerror(errno) << std::endl;
+      break;
     }
+
+    _udp_len[tail] = rx_bytes;
+    received = 1;
+#endif
+
+    if ( received )
+      _udp_ring.push( received );
   }
+
+  _run_udp_read_task = false;
+  _udp_ring.stop();
 }
 
 bool rfspace_source_c::start()
@@ -735,6 +937,9 @@ bool rfspace_source_c::start()
   _running = true;
   _keep_running = false;
 
+  /* drop what was queued while stopped, work() picks this up */
+  _flush = true;
+
   /* SDR-IP 4.2.1 Receiver State */
   /* NETSDR 4.2.1 Receiver State */
   unsigned char start[] = { 0x08, 0x00, 0x18, 0x00, 0x80, 0x02, 0x00, 0x00 };
@@ -745,7 +950,7 @@ bool rfspace_source_c::start()
 
   unsigned char mode = 0; /* 0 = 16 bit Contiguous Mode */
 
-  if ( 0 ) /* TODO: 24 bit Contiguous mode */
+  if ( 24 == _sample_bits ) /* 24 bit Contiguous mode */
     mode |= 0x80;
 
   if ( 0 ) /* TODO: Hardware Triggered Pulse mode */
@@ -762,9 +967,6 @@ bool rfspace_source_c::stop()
     _running = false;
   _keep_running = false;
 
-  if ( _fifo )
-    _fifo->clear();
-
   /* SDR-IP 4.2.1 Receiver State */
   /* NETSDR 4.2.1 Receiver State */
   unsigned char stop[] = { 0x08, 0x00, 0x18, 0x00, 0x00, 0x01, 0x00, 0x00 };
@@ -776,136 +978,201 @@ bool rfspace_source_c::stop()
   return transaction( stop, sizeof(stop) );
 }
 
-/* Main work function, pull samples from the socket */
+/* Main work function, pull samples from the FIFO or the datagram ring */
 int rfspace_source_c::work( int noutput_items,
                            gr_vector_const_void_star &input_items,
                            gr_vector_void_star &output_items )
 {
-  unsigned char data[1024*2];
-
   if ( ! _running )
     return WORK_DONE;
 
-  if ( RFSPACE_SDR_IQ == _radio )
+  if ( -1 != _usb ) /* SDR-IQ on a serial port */
   {
-    if ( noutput_items > 0 )
+    gr_complex *out = (gr_complex *)output_items[0];
+
+    if ( _flush.exchange(false) )
+      _fifo_ring.pop( _fifo_ring.size() );
+
+    if ( ! _fifo_ring.size() )
     {
-      gr_complex *out = (gr_complex *)output_items[0];
+      if ( ! _run_usb_read_task )
+        return WORK_DONE;
 
-      boost::unique_lock<boost::mutex> lock(_fifo_lock);
+      _fifo_ring.wait( 1, 0, RX_WAIT_USEC );
+    }
 
-      /* Wait until we have the requested number of samples */
-      int n_samples_avail = _fifo->size();
+    /* whatever is there, up to noutput_items */
+    size_t n_samples = std::min( size_t(noutput_items), _fifo_ring.size() );
+    size_t head = _fifo_ring.head();
+    size_t first = std::min( n_samples, _fifo_ring.capacity() - head );
 
-      while ( n_samples_avail < noutput_items )
-      {
-        _samp_avail.wait(lock);
-        n_samples_avail = _fifo->size();
-      }
+    memcpy( out, _fifo + head, first * sizeof(gr_complex) );
+    memcpy( out + first, _fifo, (n_samples - first) * sizeof(gr_complex) );
 
-      for ( int i = 0; i < noutput_items; ++i )
-      {
-        out[i] = _fifo->at(0);
-        _fifo->pop_front();
-      }
+    _fifo_ring.pop( n_samples );
 
-//      std::cerr << "-" << std::flush;
-    }
+    return n_samples;
+  }
 
-    return noutput_items;
+  if ( _flush.exchange(false) )
+  {
+    _udp_ring.pop( _udp_ring.size() );
+    _udp_offset = 0;
+    _udp_checked = false;
+    _gap_items = 0;
+    _resync = true;
   }
 
-#ifdef USE_ASIO
-  udp::endpoint ep;
-  size_t rx_bytes = _u.receive_from( boost::asio::buffer(data, sizeof(data)), ep );
-#else
-  struct sockaddr_in sa_in;           /* remote address */
-  socklen_t addrlen = sizeof(sa_in);  /* length of addresses */
-  ssize_t rx_bytes = recvfrom(_udp, data, sizeof(data), 0, (struct sockaddr *)&sa_in, &addrlen);
-  if ( rx_bytes <= 0 )
+  if ( ! _udp_ring.size() )
   {
-    std::cerr << "recvfrom returned " << rx_bytes << std::endl;
-    return WORK_DONE;
+    if ( ! _run_udp_read_task )
+      return WORK_DONE;
+
+    _udp_ring.wait( 1, 0, RX_WAIT_USEC );
   }
-#endif
 
   #define HEADER_SIZE 2
   #define SEQNUM_SIZE 2
+  #define SCALE_16  (1.0f/32768.0f)
+  #define SCALE_24  (1.0f/8388608.0f)
 
-//  bool is_24_bit = false;   // TODO: implement 24 bit sample format
+  gr_complex *out1 = (gr_complex *)output_items[0];
+  gr_complex *out2 = (2 == _nchan) ? (gr_complex *)output_items[1] : NULL;
 
-  /* check header */
-  if ( (0x04 == data[0] && (0x84 == data[1] || 0x82 == data[1])) )
-  {
-//    is_24_bit = false;
-  }
-  else if ( (0xA4 == data[0] && 0x85 == data[1]) ||
-            (0x84 == data[0] && 0x81 == data[1]) )
+  size_t produced = 0;
+
+  while ( produced < size_t(noutput_items) && _udp_ring.size() )
   {
-//    is_24_bit = true;
-    return 0;
-  }
-  else
-    return 0;
+    size_t slot = _udp_ring.head();
+    unsigned char *data = _udp_buf + slot * UDP_SLOT_SIZE;
+    size_t rx_bytes = _udp_len[slot];
+
+    bool is_data = rx_bytes > HEADER_SIZE + SEQNUM_SIZE;
+    bool is_24_bit = false;
+
+    /* check header */
+    if ( 0x04 == data[0] && (0x84 == data[1] || 0x82 == data[1]) )
+      is_24_bit = false;
+    else if ( (0xA4 == data[0] && 0x85 == data[1]) ||
+              (0x84 == data[0] && 0x81 == data[1]) )
+      is_24_bit = true;
+    else
+      is_data = false;
 
-  uint16_t sequence = *((uint16_t *)(data + HEADER_SIZE));
+    if ( ! is_data )
+    {
+      _udp_ring.pop();
+      _udp_offset = 0;
+      _udp_checked = false;
+      continue;
+    }
 
-  uint16_t diff = sequence - _sequence;
+    /* get pointer to samples */
+    unsigned char *sample = data + HEADER_SIZE + SEQNUM_SIZE;
 
-  if ( diff > 1 )
-  {
-    std::cerr << "Lost " << diff << " packets from "
-#ifdef USE_ASIO
-              << ep
-#else
-              << inet_ntoa(sa_in.sin_addr) << ":" << ntohs(sa_in.sin_port)
-#endif
-              << std::endl;
-  }
+    size_t sample_size = is_24_bit ? 6 : 4; /* bytes per complex sample */
+    size_t rx_samples = (rx_bytes - HEADER_SIZE - SEQNUM_SIZE) / sample_size;
+    size_t rx_items = rx_samples / _nchan;
 
-  _sequence = (0xffff == sequence) ? 0 : sequence;
+    if ( ! _udp_checked ) /* first look at this datagram */
+    {
+      uint16_t sequence = *((uint16_t *)(data + HEADER_SIZE));
 
-  /* get pointer to samples */
-  int16_t *sample = (int16_t *)(data + HEADER_SIZE + SEQNUM_SIZE);
+      uint16_t diff = sequence - _sequence;
 
-  size_t rx_samples = (rx_bytes - HEADER_SIZE - SEQNUM_SIZE) / (sizeof(int16_t) * 2);
+      if ( sequence < _sequence ) /* wrapped from 65535 to 1, skipping 0 */
+        diff--;
 
-  #define SCALE_16  (1.0f/32768.0f)
+      if ( ! _resync && (0 == diff || diff >= 0x8000) )
+      {
+        /* duplicate or late datagram, its time slot has passed already */
+        _udp_ring.pop();
+        continue;
+      }
 
-  if ( 1 == _nchan )
-  {
-    gr_complex *out = (gr_complex *)output_items[0];
-    for ( size_t i = 0; i < rx_samples; i++ )
+      if ( diff > 1 && ! _resync )
+      {
+        size_t lost = diff - 1;
+
+        _lost_packets += lost;
+        _lost_samples += lost * rx_items;
+
+        if ( GAP_ZERO == _gap )
+          _gap_items += lost * rx_items;
+#ifndef ENABLE_RUNTIME
+        else if ( GAP_TAG == _gap )
+        {
+          for ( size_t chan = 0; chan < _nchan; chan++ )
+            add_item_tag( chan, nitems_written(chan) + produced, DROPPED_KEY,
+                          pmt::from_uint64(lost * rx_items), alias_pmt() );
+        }
+#endif
+
+        std::cerr << "Lost " << lost << " packets" << std::endl;
+      }
+
+      _resync = false;
+      _udp_checked = true;
+      _sequence = (0xffff == sequence) ? 0 : sequence;
+    }
+
+    /* stand in for the lost datagrams before we continue with this one */
+    if ( _gap_items )
     {
-      out[i] = gr_complex( *(sample+0) * SCALE_16,
-                           *(sample+1) * SCALE_16 );
+      size_t count = std::min( _gap_items, noutput_items - produced );
+
+      std::fill( out1 + produced, out1 + produced + count, gr_complex(0, 0) );
+      if ( out2 )
+        std::fill( out2 + produced, out2 + produced + count, gr_complex(0, 0) );
 
-      sample += 2;
+      produced += count;
+      _gap_items -= count;
+      continue;
     }
-  }
-  else if ( 2 == _nchan )
-  {
-    rx_samples /= 2;
 
-    gr_complex *out1 = (gr_complex *)output_items[0];
-    gr_complex *out2 = (gr_complex *)output_items[1];
-    for ( size_t i = 0; i < rx_samples; i++ )
+    size_t count = std::min( rx_items - _udp_offset, noutput_items - produced );
+
+    sample += _udp_offset * _nchan * sample_size;
+
+    if ( 1 == _nchan )
+    {
+      if ( is_24_bit )
+        convert_cs24_to_cf32( sample, out1 + produced, count, SCALE_24 );
+      else
+        convert_cs16_to_cf32( sample, out1 + produced, count, SCALE_16 );
+    }
+    else if ( 2 == _nchan )
     {
-      out1[i] = gr_complex( *(sample+0) * SCALE_16,
-                            *(sample+1) * SCALE_16 );
+      /* convert both channels at once, then split them up */
+      gr_complex samples[UDP_SLOT_SIZE / 4];
+
+      if ( is_24_bit )
+        convert_cs24_to_cf32( sample, samples, count * 2, SCALE_24 );
+      else
+        convert_cs16_to_cf32( sample, samples, count * 2, SCALE_16 );
 
-      out2[i] = gr_complex( *(sample+2) * SCALE_16,
-                            *(sample+3) * SCALE_16 );
+      for ( size_t i = 0; i < count; i++ )
+      {
+        out1[produced + i] = samples[2*i+0];
+        out2[produced + i] = samples[2*i+1];
+      }
+    }
 
-      sample += 4;
+    produced += count;
+    _udp_offset += count;
+
+    if ( _udp_offset >= rx_items )
+    {
+      _udp_ring.pop();
+      _udp_offset = 0;
+      _udp_checked = false;
     }
   }
 
   #undef SCALE_16
+  #undef SCALE_24
 
-  noutput_items = rx_samples;
-
-  return noutput_items;
+  return produced;
 }
 
 /* discovery protocol internals taken from CuteSDR project */
@@ -29,12 +29,13 @@
 #include <gnuradio/block.h>
 #include <gnuradio/sync_block.h>
 
-#include <boost/circular_buffer.hpp>
+#include <boost/atomic.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 
 #include "osmosdr/ranges.h"
 #include "source_iface.h"
+#include "spsc_ring.h"
 #ifdef USE_ASIO
 using boost::asio::ip::tcp;
 using boost::asio::ip::udp;
@@ -120,6 +121,10 @@ public:
   double get_bandwidth( size_t chan = 0 );
   osmosdr::freq_range_t get_bandwidth_range( size_t chan = 0 );
 
+  /* datagrams missing from the sequence and the items they carried */
+  uint64_t get_lost_packets( void ) { return _lost_packets; }
+  uint64_t get_dropped_samples( size_t mboard = 0 ) { return _lost_samples; }
+
 private: /* functions */
   void apply_channel( unsigned char *cmd, size_t chan = 0 );
 
@@ -129,6 +134,7 @@ private: /* functions */
                     std::vector< unsigned char > &response );
 
   void usb_read_task();
+  void udp_read_task();
 
 private: /* members */
   enum radio_type
@@ -142,6 +148,17 @@ private: /* members */
 
   radio_type _radio;
 
+  /* what work() does about a sequence gap */
+  enum gap_mode
+  {
+    GAP_DROP = 0, /* carry on with the next datagram */
+    GAP_ZERO,     /* fill in zeros for the lost datagrams */
+    GAP_TAG       /* carry on, mark the gap with an rx_dropped tag */
+  };
+
+  gap_mode _gap;
+  int _sample_bits; /* 16 or 24 */
+
 #ifdef USE_ASIO
   boost::asio::io_service _io_service;
   tcp::resolver _resolver;
@@ -161,11 +178,25 @@ private: /* members */
   double _bandwidth;
 
   gr::thread::thread _thread;
-  bool _run_usb_read_task;
-
-  boost::circular_buffer<gr_complex> *_fifo;
-  boost::mutex _fifo_lock;
-  boost::condition_variable _samp_avail;
+  boost::atomic< bool > _run_usb_read_task;
+
+  /* SDR-IQ samples */
+  gr_complex *_fifo;
+  spsc_ring _fifo_ring;
+
+  /* received datagrams, one per slot of the ring */
+  unsigned char *_udp_buf;
+  std::vector< size_t > _udp_len;
+  spsc_ring _udp_ring;
+  size_t _udp_offset; /* items already taken from the head datagram */
+  bool _udp_checked;  /* sequence of the head datagram has been checked */
+  size_t _gap_items;  /* zeros still owed for lost datagrams */
+  bool _resync;
+  boost::atomic< uint64_t > _lost_packets;
+  boost::atomic< uint64_t > _lost_samples;
+  gr::thread::thread _udp_thread;
+  boost::atomic< bool > _run_udp_read_task;
+  boost::atomic< bool > _flush;
 
   std::vector< unsigned char > _resp;
   boost::mutex _resp_lock;
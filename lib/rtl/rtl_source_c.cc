@@ -32,7 +32,6 @@
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
-#include <boost/detail/endian.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <stdexcept>
@@ -42,12 +41,16 @@
 #include <rtl-sdr.h>
 
 #include "arg_helpers.h"
+#include "convert.h"
+#include "latency_helpers.h"
 
 using namespace boost::assign;
 
 #define BUF_LEN  (16 * 32 * 512) /* must be multiple of 512 */
 #define BUF_NUM   15
 #define BUF_SKIP  1 // buffers to skip due to initial garbage
+#define BUF_LEN_MIN (16 * 512) /* lower bound in latency mode */
+#define PREFILL   3 // buffers to collect before returning samples
 
 #define BYTES_PER_SAMPLE  2 // rtl device delivers 8 bit unsigned IQ data
 
@@ -84,6 +87,12 @@ rtl_source_c::rtl_source_c (const std::string &args)
         gr::io_signature::make(MIN_OUT, MAX_OUT, sizeof (gr_complex))),
     _dev(NULL),
     _buf(NULL),
+    _prefill(PREFILL),
+    _latency_prefill(1),
+    _latency_ms(0),
+    _fixed_len(false),
+    _spin_usec(0),
+    _loan(false),
     _running(false),
     _no_tuner(false),
     _auto_gain(false),
@@ -150,13 +159,15 @@ rtl_source_c::rtl_source_c (const std::string &args)
   if (dict.count("offset_tune"))
     offset_tune = boost::lexical_cast< unsigned int >( dict["offset_tune"] );
 
-  _buf_num = _buf_len = _buf_head = _buf_used = _buf_offset = 0;
+  _buf_num = _buf_len = _buf_offset = 0;
 
   if (dict.count("buffers"))
     _buf_num = boost::lexical_cast< unsigned int >( dict["buffers"] );
 
-  if (dict.count("buflen"))
+  if (dict.count("buflen")) {
     _buf_len = boost::lexical_cast< unsigned int >( dict["buflen"] );
+    _fixed_len = true;
+  }
 
   if (0 == _buf_num)
     _buf_num = BUF_NUM;
@@ -164,6 +175,26 @@ rtl_source_c::rtl_source_c (const std::string &args)
   if (0 == _buf_len || _buf_len % 512 != 0) /* len must be multiple of 512 */
     _buf_len = BUF_LEN;
 
+  if (dict.count("prefill")) {
+    _prefill = boost::lexical_cast< unsigned int >( dict["prefill"] );
+    _latency_prefill = _prefill;
+  }
+
+  if (0 == _prefill)
+    _prefill = _latency_prefill = 1;
+
+  /* size buflen and prefill from the sample rate at start() */
+  if (dict.count("latency"))
+    _latency_ms = boost::lexical_cast< double >( dict["latency"] );
+
+  /* poll for up to this many microseconds before sleeping in work() */
+  if (dict.count("spin"))
+    _spin_usec = boost::lexical_cast< unsigned int >( dict["spin"] );
+
+  /* convert straight from the USB buffers while work() keeps up */
+  if (dict.count("loan"))
+    _loan = boost::lexical_cast< unsigned int >( dict["loan"] ) != 0;
+
   if ( BUF_NUM != _buf_num || BUF_LEN != _buf_len ) {
     std::cerr << "Using " << _buf_num << " buffers of size " << _buf_len << "."
               << std::endl;
@@ -171,16 +202,7 @@ rtl_source_c::rtl_source_c (const std::string &args)
 
   _samp_avail = _buf_len / BYTES_PER_SAMPLE;
 
-  // create a lookup table for gr_complex values
-  for (unsigned int i = 0; i <= 0xffff; i++) {
-#ifdef BOOST_LITTLE_ENDIAN
-    _lut.push_back( gr_complex( (float(i & 0xff) - 127.4f) * (1.0f/128.0f),
-                                (float(i >> 8) - 127.4f) * (1.0f/128.0f) ) );
-#else // BOOST_BIG_ENDIAN
-    _lut.push_back( gr_complex( (float(i >> 8) - 127.4f) * (1.0f/128.0f),
-                                (float(i & 0xff) - 127.4f) * (1.0f/128.0f) ) );
-#endif
-  }
+  _ring.reset( _buf_num );
 
   _dev = NULL;
   ret = rtlsdr_open( &_dev, dev_index );
@@ -236,6 +258,8 @@ rtl_source_c::rtl_source_c (const std::string &args)
     for(unsigned int i = 0; i < _buf_num; ++i)
       _buf[i] = (unsigned short *) malloc(_buf_len);
   }
+
+  _slot.resize( _buf_num, NULL );
 }
 
 /*
@@ -267,6 +291,12 @@ rtl_source_c::~rtl_source_c ()
 
 bool rtl_source_c::start()
 {
+  size_buffers( true );
+
+  _ring.reset( _buf_num );
+  _samp_avail = _buf_len / BYTES_PER_SAMPLE;
+  _buf_offset = 0;
+
   _running = true;
   _thread = gr::thread::thread(_rtlsdr_wait, this);
 
@@ -276,6 +306,7 @@ bool rtl_source_c::start()
 bool rtl_source_c::stop()
 {
   _running = false;
+  _loan_cond.notify_one();
   if (_dev)
     rtlsdr_cancel_async( _dev );
   _thread.join();
@@ -296,21 +327,55 @@ void rtl_source_c::rtlsdr_callback(unsigned char *buf, uint32_t len)
     return;
   }
 
-  {
-    boost::mutex::scoped_lock lock( _buf_mutex );
+  /* the consumer owns the head, so on overflow the newest buffer is lost */
+  if (_ring.full()) {
+    std::cerr << "O" << std::flush;
+    return;
+  }
 
-    int buf_tail = (_buf_head + _buf_used) % _buf_num;
-    memcpy(_buf[buf_tail], buf, len);
+  unsigned int slot = _ring.tail();
 
-    if (_buf_used == _buf_num) {
-      std::cerr << "O" << std::flush;
-      _buf_head = (_buf_head + 1) % _buf_num;
-    } else {
-      _buf_used++;
-    }
+  if (_loan && _ring.size() == 0) {
+    rtlsdr_loan(slot, buf, len);
+    return;
   }
 
-  _buf_cond.notify_one();
+  memcpy(_buf[slot], buf, len);
+  _slot[slot] = _buf[slot];
+  _ring.push();
+}
+
+/*
+ * Lends the USB buffer to work() when it is waiting for data. librtlsdr
+ * resubmits the transfer as soon as we return, so we block until work()
+ * has converted it. The other transfers keep streaming meanwhile. If
+ * work() does not get to it within half the time they cover, the buffer
+ * is copied as usual to avoid stalling the device.
+ */
+void rtl_source_c::rtlsdr_loan(unsigned int slot, unsigned char *buf, uint32_t len)
+{
+  double rate = get_sample_rate();
+  double usec = 10000;
+
+  if (rate > 0)
+    usec = (_buf_num - 1) * (len / BYTES_PER_SAMPLE) / rate * 1e6 / 2;
+
+  boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() +
+                                      boost::posix_time::microseconds( (long)usec );
+
+  boost::mutex::scoped_lock lock( _loan_mutex );
+
+  _slot[slot] = (const unsigned short *)buf;
+  _ring.push();
+
+  while (_ring.size() && _running)
+    if (!_loan_cond.timed_wait( lock, deadline ))
+      break;
+
+  if (_ring.size()) {
+    memcpy(_buf[slot], buf, len);
+    _slot[slot] = _buf[slot];
+  }
 }
 
 void rtl_source_c::_rtlsdr_wait(rtl_source_c *obj)
@@ -327,7 +392,44 @@ void rtl_source_c::rtlsdr_wait()
   if ( ret != 0 )
     std::cerr << "rtlsdr_read_async returned with " << ret << std::endl;
 
-  _buf_cond.notify_one();
+  _ring.stop();
+}
+
+/*
+ * In latency mode derives the buffer length (only while not streaming)
+ * and the prefill from the sample rate, so that the prefill buffers span
+ * the requested latency. An explicit buflen is kept as is.
+ */
+void rtl_source_c::size_buffers(bool resize)
+{
+  if (_latency_ms <= 0)
+    return;
+
+  double rate = get_sample_rate();
+
+  if (resize && !_fixed_len) {
+    unsigned int len = latency_to_buflen( rate, _latency_ms, _latency_prefill,
+                                          BYTES_PER_SAMPLE, 512,
+                                          BUF_LEN_MIN, BUF_LEN );
+
+    if (len != _buf_len && _buf) {
+      for (unsigned int i = 0; i < _buf_num; ++i) {
+        free(_buf[i]);
+        _buf[i] = (unsigned short *) malloc(len);
+      }
+
+      _buf_len = len;
+    }
+  }
+
+  _prefill = latency_to_prefill( rate, _latency_ms, _buf_len,
+                                 BYTES_PER_SAMPLE, _buf_num );
+
+  if (rate > 0)
+    std::cerr << "Using " << _buf_num << " buffers of size " << _buf_len
+              << ", prefill " << _prefill << " ("
+              << _prefill * (_buf_len / BYTES_PER_SAMPLE) / rate * 1e3
+              << " ms)." << std::endl;
 }
 
 int rtl_source_c::work( int noutput_items,
@@ -336,33 +438,28 @@ int rtl_source_c::work( int noutput_items,
 {
   gr_complex *out = (gr_complex *)output_items[0];
 
-  {
-    boost::mutex::scoped_lock lock( _buf_mutex );
-
-    while (_buf_used < 3 && _running) // collect at least 3 buffers
-      _buf_cond.wait( lock );
-  }
-
-  if (!_running)
+  // collect the prefill buffers, a loaned one has to be consumed right away
+  if (!_ring.wait( _loan ? 1 : std::min(_prefill, _buf_num), _spin_usec ) || !_running)
     return WORK_DONE;
 
-  while (noutput_items && _buf_used) {
+  while (noutput_items && _ring.size()) {
     const int nout = std::min(noutput_items, _samp_avail);
-    const unsigned short *buf = _buf[_buf_head] + _buf_offset;
 
-    for (int i = 0; i < nout; ++i)
-      *out++ = _lut[ *(buf + i) ];
+    /* keeps the callback from taking back a loaned buffer under our feet */
+    boost::mutex::scoped_lock lock( _loan_mutex, boost::defer_lock );
+    if (_loan)
+      lock.lock();
+
+    convert_cu8_to_cf32( _slot[_ring.head()] + _buf_offset, out, nout, 127.4f, 1.0f/128.0f );
+    out += nout;
 
     noutput_items -= nout;
     _samp_avail -= nout;
 
     if (!_samp_avail) {
-      {
-        boost::mutex::scoped_lock lock( _buf_mutex );
-
-        _buf_head = (_buf_head + 1) % _buf_num;
-        _buf_used--;
-      }
+      _ring.pop();
+      if (_loan)
+        _loan_cond.notify_one();
       _samp_avail = _buf_len / BYTES_PER_SAMPLE;
       _buf_offset = 0;
     } else {
@@ -441,6 +538,8 @@ double rtl_source_c::set_sample_rate(double rate)
     rtlsdr_set_sample_rate( _dev, (uint32_t)rate );
   }
 
+  size_buffers( false );
+
   return get_sample_rate();
 }
 
@@ -29,6 +29,7 @@
 #include <boost/thread/condition_variable.hpp>
 
 #include "source_iface.h"
+#include "spsc_ring.h"
 
 class rtl_source_c;
 typedef struct rtlsdr_dev rtlsdr_dev_t;
@@ -119,20 +120,26 @@ protected:
 private:
   static void _rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx);
   void rtlsdr_callback(unsigned char *buf, uint32_t len);
+  void rtlsdr_loan(unsigned int slot, unsigned char *buf, uint32_t len);
+  void size_buffers(bool resize);
   static void _rtlsdr_wait(rtl_source_c *obj);
   void rtlsdr_wait();
 
-  std::vector<gr_complex> _lut;
-
   rtlsdr_dev_t *_dev;
   gr::thread::thread _thread;
   unsigned short **_buf;
   unsigned int _buf_num;
   unsigned int _buf_len;
-  unsigned int _buf_head;
-  unsigned int _buf_used;
-  boost::mutex _buf_mutex;
-  boost::condition_variable _buf_cond;
+  spsc_ring _ring;
+  unsigned int _prefill;
+  unsigned int _latency_prefill;
+  double _latency_ms;
+  bool _fixed_len;
+  unsigned int _spin_usec;
+  std::vector< const unsigned short * > _slot;
+  bool _loan;
+  boost::mutex _loan_mutex;
+  boost::condition_variable _loan_cond;
   bool _running;
 
   unsigned int _buf_offset;
@@ -0,0 +1,592 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * Runs the rtl_tcp client against a fake server on the loopback. The
+ * server answers the format request with "RTLX" and streams a known
+ * signal in the agreed wire format, or answers with "RTL0" like a
+ * classic server. It closes the connection after the signal, which ends
+ * the flowgraph, and the samples that came out must match the signal.
+ * The reconnect cases take the client back after an outage instead.
+ *
+ * usage: qa_rtl_tcp, returns nonzero if a case failed
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <gnuradio/io_signature.h>
+#include <gnuradio/sync_block.h>
+#include <gnuradio/top_block.h>
+
+#include <osmosdr/source.h>
+
+/* as in rtl_tcp_source_f.cc, the test has to agree with it on the wire */
+#define CMD_SET_FORMAT 0x50
+
+enum { FMT_CU8 = 0, FMT_CU4, FMT_CS16, FMT_DELTA };
+
+static const int8_t CU4_LEVELS[16] =
+  { -105, -72, -48, -32, -20, -12, -6, -2, 2, 6, 12, 20, 32, 48, 72, 105 };
+
+#define NSAMPLES 8192           // a multiple of the 64 samples per delta block
+#define TOLERANCE 1e-5f
+
+static int failures = 0;
+
+static void check( bool ok, const std::string &what )
+{
+  if ( !ok ) {
+    fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+  }
+}
+
+/* collects what comes out of the source */
+class vector_sink : public gr::sync_block
+{
+public:
+  vector_sink()
+    : gr::sync_block("vector_sink",
+                     gr::io_signature::make(1, 1, sizeof(gr_complex)),
+                     gr::io_signature::make(0, 0, 0))
+  {
+  }
+
+  int work( int noutput_items,
+            gr_vector_const_void_star &input_items,
+            gr_vector_void_star &output_items )
+  {
+    const gr_complex *in = (const gr_complex *) input_items[0];
+
+    boost::mutex::scoped_lock lock(_mutex);
+    data.insert(data.end(), in, in + noutput_items);
+    return noutput_items;
+  }
+
+  /* while the flowgraph runs */
+  size_t size()
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    return data.size();
+  }
+
+  std::vector< gr_complex > data;
+
+private:
+  boost::mutex _mutex;
+};
+
+typedef std::pair< unsigned char, uint32_t > command_t;
+
+/*
+ * Serves one connection per payload. With a reply format it expects the
+ * format request first, otherwise it ignores it like a classic server.
+ * Reads the commands until the client hangs up, so closing on it does
+ * not reset the connection before it got the last samples. Between two
+ * connections the port stays closed for outage_ms, and after the last
+ * one it is closed for good.
+ */
+class fake_server
+{
+public:
+  fake_server( bool extended, int format, int decim,
+               const std::vector< unsigned char > &payload )
+    : _extended(extended), _format(format), _decim(decim),
+      _payloads(1, payload), _outage_ms(0), _request(-1)
+  {
+    listen_on(0);
+    _thread = boost::thread(boost::bind(&fake_server::serve, this));
+  }
+
+  fake_server( bool extended, int format, int decim,
+               const std::vector< std::vector< unsigned char > > &payloads,
+               int outage_ms )
+    : _extended(extended), _format(format), _decim(decim),
+      _payloads(payloads), _outage_ms(outage_ms), _request(-1)
+  {
+    listen_on(0);
+    _thread = boost::thread(boost::bind(&fake_server::serve, this));
+  }
+
+  ~fake_server()
+  {
+    join();
+  }
+
+  unsigned short port() const { return _port; }
+
+  /* until the client hung up on the last connection */
+  void join()
+  {
+    if ( _thread.joinable() )
+      _thread.join();
+  }
+
+  /* the parameter of the first format request, -1 if there was none */
+  int request() const { return _request; }
+
+  /* what the client sent on a connection, after the format request */
+  const std::vector< command_t > &commands( size_t conn ) const
+  {
+    return _commands.at(conn);
+  }
+
+private:
+  void listen_on( unsigned short port )
+  {
+    _listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    int opt_val = 1;
+    setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &opt_val, sizeof(opt_val));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port); // 0 for any free port
+
+    socklen_t len = sizeof(addr);
+    if ( bind(_listener, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+         listen(_listener, 1) != 0 ||
+         getsockname(_listener, (sockaddr *)&addr, &len) != 0 )
+      throw std::runtime_error("can't set up the fake server");
+
+    _port = ntohs(addr.sin_port);
+  }
+
+  static bool send_all( int fd, const void *buf, size_t len )
+  {
+    const char *p = (const char *)buf;
+
+    while ( len ) {
+      ssize_t sent = send(fd, p, len, MSG_NOSIGNAL);
+      if ( sent <= 0 )
+        return false;
+
+      p += sent;
+      len -= sent;
+    }
+
+    return true;
+  }
+
+  static bool recv_all( int fd, void *buf, size_t len )
+  {
+    char *p = (char *)buf;
+
+    while ( len ) {
+      ssize_t received = recv(fd, p, len, 0);
+      if ( received <= 0 )
+        return false;
+
+      p += received;
+      len -= received;
+    }
+
+    return true;
+  }
+
+  void serve()
+  {
+    for ( size_t conn = 0; conn < _payloads.size(); conn++ ) {
+      if ( conn ) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(_outage_ms));
+        listen_on(_port);
+      }
+
+      int fd = accept(_listener, NULL, NULL);
+      close(_listener); // refuse the client until the next round
+      if ( fd == -1 )
+        return;
+
+      serve_one(fd, _payloads[conn]);
+      close(fd);
+    }
+  }
+
+  void serve_one( int fd, const std::vector< unsigned char > &payload )
+  {
+    unsigned char info[12 + 8];
+    memcpy(info, _extended ? "RTLX" : "RTL0", 4);
+
+    uint32_t words[4] = { htonl(5),   // R820T
+                          htonl(29),  // its gains
+                          htonl(_format),
+                          htonl(_decim) };
+    memcpy(info + 4, words, sizeof(words));
+
+    unsigned char cmd[5];
+
+    if ( _extended && recv_all(fd, cmd, sizeof(cmd)) &&
+         CMD_SET_FORMAT == cmd[0] && -1 == _request ) {
+      uint32_t param;
+      memcpy(&param, cmd + 1, sizeof(param));
+      _request = ntohl(param);
+    }
+
+    if ( send_all(fd, info, _extended ? 20 : 12) && payload.size() )
+      send_all(fd, &payload[0], payload.size());
+
+    shutdown(fd, SHUT_WR);
+
+    std::vector< command_t > commands;
+
+    while ( recv_all(fd, cmd, sizeof(cmd)) ) {
+      uint32_t param;
+      memcpy(&param, cmd + 1, sizeof(param));
+      commands.push_back(command_t(cmd[0], ntohl(param)));
+    }
+
+    _commands.push_back(commands);
+  }
+
+  bool _extended;
+  int _format;
+  int _decim;
+  std::vector< std::vector< unsigned char > > _payloads;
+  int _outage_ms;
+  int _request;
+  std::vector< std::vector< command_t > > _commands;
+  int _listener;
+  unsigned short _port;
+  boost::thread _thread;
+};
+
+/* a slow sweep, so most delta blocks pack, and noise for the ones that don't */
+static unsigned char test_byte( size_t i )
+{
+  if ( (i / 1024) % 4 == 3 )
+    return (unsigned char)((i * 2654435761u) >> 13);
+
+  double phase = 2 * M_PI * (i / 2) / 512.0;
+  return (unsigned char)lrint(127.5 + 100 * ((i & 1) ? sin(phase) : cos(phase)));
+}
+
+static gr_complex cu8_sample( unsigned char i, unsigned char q )
+{
+  return gr_complex((i - 127.4f) / 128.0f, (q - 127.4f) / 128.0f);
+}
+
+/* samples first to first + n of the cu8 test signal, appended */
+static void cu8_signal( size_t first, size_t n,
+                        std::vector< unsigned char > &payload,
+                        std::vector< gr_complex > &expected )
+{
+  for ( size_t i = first; i < first + n; i++ ) {
+    payload.push_back(test_byte(2 * i));
+    payload.push_back(test_byte(2 * i + 1));
+    expected.push_back(cu8_sample(test_byte(2 * i), test_byte(2 * i + 1)));
+  }
+}
+
+/* the same for cs16, with the low bytes in use too */
+static void cs16_signal( size_t first, size_t n,
+                         std::vector< unsigned char > &payload,
+                         std::vector< gr_complex > &expected )
+{
+  for ( size_t i = first; i < first + n; i++ ) {
+    int16_t iq[2] = { (int16_t)((test_byte(2 * i) - 128) * 256 + (int)i % 256),
+                      (int16_t)((test_byte(2 * i + 1) - 128) * 256 - (int)i % 256) };
+
+    for ( int k = 0; k < 2; k++ ) {
+      payload.push_back((uint16_t)iq[k] & 0xff);
+      payload.push_back((uint16_t)iq[k] >> 8);
+    }
+
+    expected.push_back(gr_complex(iq[0] / 32768.0f, iq[1] / 32768.0f));
+  }
+}
+
+static unsigned int zigzag( int delta )
+{
+  return delta < 0 ? (unsigned int)(-delta) * 2 - 1 : (unsigned int)delta * 2;
+}
+
+/* the narrowest width for each block of 64 samples */
+static std::vector< unsigned char > delta_encode( const std::vector< unsigned char > &in )
+{
+  std::vector< unsigned char > out;
+
+  for ( size_t pos = 0; pos < in.size(); pos += 128 ) {
+    const unsigned char *block = &in[pos];
+    unsigned int codes[128];
+    unsigned int width = 0;
+
+    for ( size_t i = 2; i < 128; i++ ) {
+      codes[i] = zigzag((int8_t)(block[i] - block[i - 2]));
+      while ( (codes[i] >> width) && width < 8 )
+        width++;
+    }
+
+    out.push_back(width);
+
+    if ( width >= 8 ) {
+      out.insert(out.end(), block, block + 128);
+      continue;
+    }
+
+    out.push_back(block[0]);
+    out.push_back(block[1]);
+
+    unsigned int acc = 0, nbits = 0;
+    for ( size_t i = 2; i < 128; i++ ) {
+      acc |= codes[i] << nbits;
+      nbits += width;
+
+      while ( nbits >= 8 ) {
+        out.push_back(acc & 0xff);
+        acc >>= 8;
+        nbits -= 8;
+      }
+    }
+
+    if ( nbits )
+      out.push_back(acc & 0xff);
+  }
+
+  return out;
+}
+
+static std::vector< gr_complex > run_client( const std::string &name,
+                                             const std::string &args,
+                                             fake_server &server,
+                                             osmosdr::source::sptr *keep = NULL )
+{
+  std::string dev = "rtl_tcp=127.0.0.1:" +
+                    boost::lexical_cast< std::string >( server.port() ) +
+                    ",reconnect=0," + args;
+
+  osmosdr::source::sptr src = osmosdr::source::make( dev );
+  boost::shared_ptr< vector_sink > sink( new vector_sink() );
+
+  gr::top_block_sptr tb = gr::make_top_block( name );
+  tb->connect( src, 0, sink, 0 );
+  tb->run();
+
+  if ( keep )
+    *keep = src;
+
+  return sink->data;
+}
+
+static void compare( const std::string &name,
+                     const std::vector< gr_complex > &got,
+                     const std::vector< gr_complex > &expected )
+{
+  check( got.size() == expected.size(),
+         name + ": got " + boost::lexical_cast< std::string >( got.size() ) +
+         " samples, expected " + boost::lexical_cast< std::string >( expected.size() ) );
+
+  size_t n = std::min(got.size(), expected.size());
+  for ( size_t i = 0; i < n; i++ ) {
+    if ( std::abs(got[i] - expected[i]) > TOLERANCE ) {
+      check( false, name + ": sample " + boost::lexical_cast< std::string >( i ) +
+                    " differs" );
+      break;
+    }
+  }
+}
+
+static void test_cu4()
+{
+  std::vector< unsigned char > payload(NSAMPLES);
+  std::vector< gr_complex > expected(NSAMPLES);
+
+  for ( size_t i = 0; i < NSAMPLES; i++ ) {
+    payload[i] = test_byte(i);
+    expected[i] = gr_complex(CU4_LEVELS[payload[i] >> 4] / 128.0f,
+                             CU4_LEVELS[payload[i] & 0xf] / 128.0f);
+  }
+
+  fake_server server(true, FMT_CU4, 1, payload);
+  std::vector< gr_complex > got = run_client("cu4", "format=cu4", server);
+
+  check( server.request() == (1 << 8 | FMT_CU4), "cu4: wrong format request" );
+  compare( "cu4", got, expected );
+}
+
+static void test_cs16()
+{
+  std::vector< unsigned char > payload;
+  std::vector< gr_complex > expected;
+
+  cs16_signal(0, NSAMPLES, payload, expected);
+
+  fake_server server(true, FMT_CS16, 4, payload);
+  osmosdr::source::sptr src;
+  std::vector< gr_complex > got = run_client("cs16", "format=cs16,decim=4", server, &src);
+
+  check( server.request() == (4 << 8 | FMT_CS16), "cs16: wrong format request" );
+  check( src->get_sample_rates().stop() == 2560000 / 4,
+         "cs16: the sample rates are not decimated" );
+  compare( "cs16", got, expected );
+}
+
+static void test_delta()
+{
+  std::vector< unsigned char > raw(NSAMPLES * 2);
+  std::vector< gr_complex > expected(NSAMPLES);
+
+  for ( size_t i = 0; i < raw.size(); i++ )
+    raw[i] = test_byte(i);
+
+  for ( size_t i = 0; i < NSAMPLES; i++ )
+    expected[i] = cu8_sample(raw[2 * i], raw[2 * i + 1]);
+
+  std::vector< unsigned char > payload = delta_encode(raw);
+  check( payload.size() < raw.size(), "delta: the test signal does not pack" );
+
+  fake_server server(true, FMT_DELTA, 1, payload);
+  std::vector< gr_complex > got = run_client("delta", "format=delta", server);
+
+  check( server.request() == (1 << 8 | FMT_DELTA), "delta: wrong format request" );
+  compare( "delta", got, expected );
+}
+
+/* a classic server ignores the request, we get cu8 */
+static void test_fallback()
+{
+  std::vector< unsigned char > payload;
+  std::vector< gr_complex > expected;
+
+  cu8_signal(0, NSAMPLES, payload, expected);
+
+  fake_server server(false, FMT_CU8, 1, payload);
+  std::vector< gr_complex > got = run_client("fallback", "format=cu4", server);
+
+  compare( "fallback", got, expected );
+}
+
+/*
+ * The server drops the client half way through a sample and takes it back
+ * after an outage, during which the port refuses connections. The cut
+ * sample must be filled up with silence, the settings replayed, and the
+ * rest of the stream must follow on the sample boundary. With gap=zero
+ * the outage shows up as a run of zeros as long as the samples it cost,
+ * otherwise only in the dropped count.
+ */
+static void test_reconnect( int format, const std::string &gap )
+{
+  const bool cs16 = FMT_CS16 == format;
+  const size_t half = cs16 ? 2 : 1;
+  const int decim = cs16 ? 2 : 1;
+  std::string name = std::string(cs16 ? "cs16" : "cu8") + " reconnect, gap=" + gap;
+
+  std::vector< std::vector< unsigned char > > payloads(2);
+  std::vector< gr_complex > before, after;
+
+  if ( cs16 ) {
+    cs16_signal(0, NSAMPLES, payloads[0], before);
+    cs16_signal(NSAMPLES, NSAMPLES, payloads[1], after);
+  } else {
+    cu8_signal(0, NSAMPLES, payloads[0], before);
+    cu8_signal(NSAMPLES, NSAMPLES, payloads[1], after);
+  }
+
+  // only I of the last sample makes it, Q is padded with silence
+  payloads[0].resize(payloads[0].size() - half);
+  before.back() = gr_complex(before.back().real(), cs16 ? 0.0f : cu8_sample(0x80, 0x80).imag());
+
+  // a classic server for cu8, the client would wait for it to talk first
+  fake_server server(cs16, format, decim, payloads, 300);
+
+  std::string dev = "rtl_tcp=127.0.0.1:" +
+                    boost::lexical_cast< std::string >( server.port() ) +
+                    ",reconnect=1,gap=" + gap +
+                    ",format=" + (cs16 ? "cs16,decim=2" : "cu8");
+
+  osmosdr::source::sptr src = osmosdr::source::make( dev );
+  src->set_sample_rate( src->get_sample_rates().start() );
+  src->set_center_freq( 100e6 );
+  src->set_gain( 20 );
+
+  boost::shared_ptr< vector_sink > sink( new vector_sink() );
+  gr::top_block_sptr tb = gr::make_top_block( name );
+  tb->connect( src, 0, sink, 0 );
+  tb->start();
+
+  // the client got everything once it hangs up on the second connection
+  server.join();
+  uint64_t lost = src->get_dropped_samples();
+
+  std::vector< gr_complex > expected = before;
+  if ( "zero" == gap )
+    expected.resize(expected.size() + lost, gr_complex(0, 0));
+  expected.insert(expected.end(), after.begin(), after.end());
+
+  for ( int waited = 0; sink->size() < expected.size() && waited < 5000; waited += 10 )
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+
+  tb->stop();
+  tb->wait();
+
+  // the port was closed for 300 ms
+  check( lost >= src->get_sample_rate() / 4,
+         name + ": the outage cost " + boost::lexical_cast< std::string >( lost ) +
+         " samples" );
+
+  // the latest value per command, the way the client remembers them
+  std::map< unsigned char, uint32_t > sent, replayed;
+  for ( size_t i = 0; i < server.commands(0).size(); i++ )
+    sent[server.commands(0)[i].first] = server.commands(0)[i].second;
+  for ( size_t i = 0; i < server.commands(1).size(); i++ )
+    replayed[server.commands(1)[i].first] = server.commands(1)[i].second;
+
+  check( sent.size() >= 3, name + ": the settings were not sent" );
+  check( sent == replayed, name + ": the settings were not replayed" );
+
+  compare( name, sink->data, expected );
+}
+
+int main( int argc, char **argv )
+{
+  test_cu4();
+  test_cs16();
+  test_delta();
+  test_fallback();
+  test_reconnect( FMT_CU8, "zero" );
+  test_reconnect( FMT_CS16, "zero" );
+  test_reconnect( FMT_CU8, "tag" );
+
+  if ( failures )
+    fprintf(stderr, "%d checks failed\n", failures);
+  else
+    printf("all rtl_tcp checks passed\n");
+
+  return failures ? 1 : 0;
+}
@@ -18,6 +18,10 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <fstream>
 #include <string>
 #include <sstream>
@@ -67,6 +71,12 @@ rtl_tcp_source_c::rtl_tcp_source_c(const std::string &args) :
   std::string host = "127.0.0.1";
   unsigned short port = 1234;
   int payload_size = 16384;
+  int readahead_ms = 250;
+  int rcvbuf = 4*1024*1024;
+  bool reconnect = true;
+  rtl_tcp_gap_mode gap = RTL_TCP_GAP_DROP;
+  rtl_tcp_format format = RTL_TCP_FORMAT_CU8;
+  int decim = 4;
   unsigned int direct_samp = 0, offset_tune = 0;
 
   _freq = 0;
@@ -90,6 +100,57 @@ rtl_tcp_source_c::rtl_tcp_source_c(const std::string &args) :
   if (dict.count("psize"))
     payload_size = boost::lexical_cast< int >( dict["psize"] );
 
+  if (dict.count("readahead_ms"))
+    readahead_ms = boost::lexical_cast< int >( dict["readahead_ms"] );
+
+  if (dict.count("rcvbuf"))
+    rcvbuf = boost::lexical_cast< int >( dict["rcvbuf"] );
+
+  if (dict.count("reconnect"))
+    reconnect = boost::lexical_cast< unsigned int >( dict["reconnect"] ) != 0;
+
+  if (dict.count("gap")) {
+    std::string mode = dict["gap"];
+
+    if ("zero" == mode)
+      gap = RTL_TCP_GAP_ZERO;
+    else if ("drop" == mode)
+      gap = RTL_TCP_GAP_DROP;
+    else if ("tag" == mode)
+      gap = RTL_TCP_GAP_TAG;
+    else
+      throw std::runtime_error("Gap mode (gap) must be zero, drop or tag");
+
+#ifdef ENABLE_RUNTIME
+    if (RTL_TCP_GAP_TAG == gap) {
+      std::cerr << "Stream tags are not supported by this runtime, "
+                << "gap=tag only counts the losses" << std::endl;
+      gap = RTL_TCP_GAP_DROP;
+    }
+#endif
+  }
+
+  if (dict.count("format")) {
+    std::string name = dict["format"];
+
+    if ("cu8" == name)
+      format = RTL_TCP_FORMAT_CU8;
+    else if ("cu4" == name)
+      format = RTL_TCP_FORMAT_CU4;
+    else if ("cs16" == name)
+      format = RTL_TCP_FORMAT_CS16;
+    else if ("delta" == name)
+      format = RTL_TCP_FORMAT_DELTA;
+    else
+      throw std::runtime_error("Wire format (format) must be cu8, cu4, cs16 or delta");
+  }
+
+  if (dict.count("decim"))
+    decim = boost::lexical_cast< int >( dict["decim"] );
+
+  if (decim < 1 || decim > 255)
+    throw std::runtime_error("Decimation (decim) must be between 1 and 255");
+
   if (dict.count("direct_samp"))
     direct_samp = boost::lexical_cast< unsigned int >( dict["direct_samp"] );
 
@@ -105,7 +166,12 @@ rtl_tcp_source_c::rtl_tcp_source_c(const std::string &args) :
   if (payload_size <= 0)
     payload_size = 16384;
 
-  _src = make_rtl_tcp_source_f(sizeof(float), host.c_str(), port, payload_size);
+  if (readahead_ms <= 0)
+    readahead_ms = 250;
+
+  _src = make_rtl_tcp_source_f(sizeof(float), host.c_str(), port, payload_size,
+                               false, false, readahead_ms, rcvbuf,
+                               reconnect, gap, format, decim);
 
   if ( _src->get_tuner_type() != RTLSDR_TUNER_UNKNOWN )
   {
@@ -117,6 +183,14 @@ rtl_tcp_source_c::rtl_tcp_source_c(const std::string &args) :
               << std::endl;
   }
 
+  if ( _src->get_format() != RTL_TCP_FORMAT_CU8 ) {
+    std::cerr << "Using the " << rtl_tcp_format_name( _src->get_format() )
+              << " wire format";
+    if ( _src->get_decimation() > 1 )
+      std::cerr << ", decimated by " << _src->get_decimation();
+    std::cerr << "." << std::endl;
+  }
+
   set_gain_mode(false); /* enable manual gain mode by default */
 
   _src->set_direct_sampling(direct_samp);
@@ -175,6 +249,17 @@ osmosdr::meta_range_t rtl_tcp_source_c::get_sample_rates( void )
 //  range += osmosdr::range_t( 3000000 ); // may work
 //  range += osmosdr::range_t( 3200000 ); // max rate
 
+  // the server decimates for us in the cs16 wire format
+  int decim = _src->get_decimation();
+  if ( decim > 1 ) {
+    osmosdr::meta_range_t decimated;
+
+    for ( size_t i = 0; i < range.size(); i++ )
+      decimated += osmosdr::range_t( range[i].start() / decim );
+
+    return decimated;
+  }
+
   return range;
 }
 
@@ -460,3 +545,13 @@ std::string rtl_tcp_source_c::get_antenna( size_t chan )
 {
   return "RX";
 }
+
+uint64_t rtl_tcp_source_c::get_dropped_samples( size_t mboard )
+{
+  return _src->get_dropped_samples();
+}
+
+unsigned long rtl_tcp_source_c::get_overruns( size_t mboard )
+{
+  return _src->get_overruns();
+}
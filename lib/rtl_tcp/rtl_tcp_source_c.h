@@ -76,6 +76,9 @@ public:
   std::string set_antenna( const std::string & antenna, size_t chan = 0 );
   std::string get_antenna( size_t chan = 0 );
 
+  uint64_t get_dropped_samples( size_t mboard = 0 );
+  unsigned long get_overruns( size_t mboard = 0 );
+
 private:
   double _freq, _rate, _gain, _corr;
   bool _no_tuner;
@@ -20,20 +20,36 @@
  */
 //#define HAVE_WINDOWS_H
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
 
 #include <rtl_tcp_source_f.h>
 #include <gnuradio/io_signature.h>
+#ifndef ENABLE_RUNTIME
+#include <gnuradio/tags.h>
+#include <pmt/pmt.h>
+#endif
+#include <algorithm>
 #include <stdexcept>
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "convert.h"
+
 #ifndef _WIN32
 #include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
 #else
 #include <WinSock2.h>
 #endif
 
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // a send to a dead server must not raise SIGPIPE
+#endif
+
 /* copied from rtl sdr code */
 typedef struct { /* structure size must be multiple of 2 bytes */
   char magic[4];
@@ -41,11 +57,66 @@ typedef struct { /* structure size must be multiple of 2 bytes */
   uint32_t tuner_gain_count;
 } dongle_info_t;
 
+#ifdef _WIN32
+#define __attribute__(x)
+#pragma pack(push, 1)
+#endif
+struct command{
+  unsigned char cmd;
+  unsigned int param;
+}__attribute__((packed));
+#ifdef _WIN32
+#pragma pack(pop)
+#endif
+
 #define USE_SELECT    1  // non-blocking receive on all platforms
 #define USE_RCV_TIMEO 0  // non-blocking receive on all but Cygwin
 #define SRC_VERBOSE 0
 #define SNK_VERBOSE 0
 
+#define RX_WAIT_USEC 100000       // how long either thread waits for the other
+#define MAX_SAMPLE_RATE 3200000   // sizes the ring until we know the rate
+
+/*
+ * Compact wire formats. A client that wants one sends SET_FORMAT right
+ * after connecting, with the format in the low and the decimation in the
+ * next byte of the parameter. A server that knows the extension waits a
+ * moment for it before sending the dongle info, then answers with the
+ * magic "RTLX" followed by the agreed format and decimation as two more
+ * big endian words. A classic server ignores the command and answers
+ * with "RTL0", so we stay with cu8.
+ *
+ *  cu4:   one byte per sample, I in the high and Q in the low nibble,
+ *         companded through CU4_LEVELS
+ *  cs16:  16 bit little endian I/Q at the dongle rate over the decimation
+ *  delta: cu8 in blocks of 64 samples. A block starts with the bit width
+ *         w of its deltas. For w = 8 the 128 bytes follow as they are,
+ *         otherwise the first I and Q bytes, then 126 zigzag coded
+ *         deltas to the value two bytes before, packed LSB first.
+ */
+#define CMD_SET_FORMAT 0x50
+
+#define DELTA_BLOCK_BYTES 128
+#define DELTA_MAX_BLOCK   (1 + DELTA_BLOCK_BYTES)
+
+static const int8_t CU4_LEVELS[16] =
+  { -105, -72, -48, -32, -20, -12, -6, -2, 2, 6, 12, 20, 32, 48, 72, 105 };
+
+const char *rtl_tcp_format_name(rtl_tcp_format format)
+{
+  static const char *names[] = { "cu8", "cu4", "cs16", "delta" };
+
+  return names[format];
+}
+
+#define CONNECT_TIMEOUT_USEC 3000000  // for the handshake and the dongle info
+#define RECONNECT_MIN_MS 100          // first retry, doubled after each failure
+#define RECONNECT_MAX_MS 5000
+
+#ifndef ENABLE_RUNTIME
+static const pmt::pmt_t DROPPED_KEY = pmt::string_to_symbol("rx_dropped");
+#endif
+
 static int is_error( int perr )
 {
   // Compare error to posix error code; return nonzero if match.
@@ -82,12 +153,144 @@ static void report_error( const char *msg1, const char *msg2 )
   return;
 }
 
+// true if the last socket call just ran out of time or got interrupted
+static bool is_transient_error()
+{
+#if defined(USING_WINSOCK)
+  int werr = WSAGetLastError();
+  return werr == WSAEWOULDBLOCK || werr == WSAEINTR || werr == WSAETIMEDOUT;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static int set_nonblocking( int fd, bool on )
+{
+#if defined(USING_WINSOCK)
+  u_long mode = on ? 1 : 0;
+  return ioctlsocket( fd, FIONBIO, &mode );
+#else
+  int flags = fcntl( fd, F_GETFL, 0 );
+  if( flags == -1 )
+    return -1;
+  return fcntl( fd, F_SETFL, on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK) );
+#endif
+}
+
+// true if a non-blocking connect() went on in the background
+static bool is_in_progress()
+{
+#if defined(USING_WINSOCK)
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+static void close_socket( int fd )
+{
+  shutdown(fd, SHUT_RDWR);
+#if defined(USING_WINSOCK)
+  closesocket(fd);
+#else
+  ::close(fd);
+#endif
+}
+
+// waits for the socket to become readable or writable, 1 if it did
+static int wait_socket( int fd, bool for_write, int timeout_usec )
+{
+  fd_set fds, errfds;
+  FD_ZERO(&fds);
+  FD_SET(fd, &fds);
+  FD_ZERO(&errfds);
+  FD_SET(fd, &errfds);  // winsock signals a failed connect here
+
+  timeval timeout;
+  timeout.tv_sec = timeout_usec / 1000000;
+  timeout.tv_usec = timeout_usec % 1000000;
+
+  int ret = select(fd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL,
+                   &errfds, &timeout);
+  if (ret > 0 && FD_ISSET(fd, &errfds) && !FD_ISSET(fd, &fds))
+    return -1;
+
+  return ret;
+}
+
+static bool send_raw( int fd, unsigned char code, unsigned int param )
+{
+  struct command cmd = { code, htonl(param) };
+  return send(fd, (const char*)&cmd, sizeof(cmd), MSG_NOSIGNAL) == sizeof(cmd);
+}
+
+static bool recv_all( int fd, void *buf, size_t len )
+{
+  char *p = (char *)buf;
+
+  while (len) {
+    if (wait_socket(fd, false, CONNECT_TIMEOUT_USEC) <= 0)
+      return false;
+
+    ssize_t received = recv(fd, p, len, 0);
+    if (received <= 0)
+      return false;
+
+    p += received;
+    len -= received;
+  }
+
+  return true;
+}
+
+/* one delta block, in points at the width byte */
+static void delta_decode( const unsigned char *in, unsigned char *out )
+{
+  unsigned int width = in[0];
+
+  if (width >= 8) {
+    memcpy(out, in + 1, DELTA_BLOCK_BYTES);
+    return;
+  }
+
+  const unsigned char *bits = in + 3;
+  unsigned int mask = (1u << width) - 1;
+  unsigned int acc = 0, nbits = 0;
+
+  out[0] = in[1];
+  out[1] = in[2];
+
+  for (size_t i = 2; i < DELTA_BLOCK_BYTES; i++) {
+    while (nbits < width) {
+      acc |= (unsigned int)*bits++ << nbits;
+      nbits += 8;
+    }
+
+    unsigned int z = acc & mask;
+    acc >>= width;
+    nbits -= width;
+
+    out[i] = (unsigned char)(out[i - 2] + ((z >> 1) ^ (0u - (z & 1))));
+  }
+}
+
+static size_t delta_block_size( unsigned int width )
+{
+  return width >= 8 ? DELTA_MAX_BLOCK : 3 + ((DELTA_BLOCK_BYTES - 2) * width + 7) / 8;
+}
+
 rtl_tcp_source_f::rtl_tcp_source_f(size_t itemsize,
                                    const char *host,
                                    unsigned short port,
                                    int payload_size,
                                    bool eof,
-                                   bool wait)
+                                   bool wait,
+                                   int readahead_ms,
+                                   int rcvbuf,
+                                   bool reconnect,
+                                   rtl_tcp_gap_mode gap,
+                                   rtl_tcp_format format,
+                                   int decim)
   : gr::sync_block ("rtl_tcp_source_f",
                    gr::io_signature::make(0, 0, 0),
                    gr::io_signature::make(1, 1, sizeof(gr_complex))),
@@ -95,7 +298,23 @@ rtl_tcp_source_f::rtl_tcp_source_f(size_t itemsize,
     d_payload_size(payload_size),
     d_eof(eof),
     d_wait(wait),
-    d_socket(-1)
+    d_socket(-1),
+    d_rcvbuf(rcvbuf),
+    d_reconnect(reconnect),
+    d_gap(gap),
+    d_format(format),
+    d_decim(RTL_TCP_FORMAT_CS16 == format ? std::max(decim, 1) : 1),
+    d_sample_bytes(2),
+    d_sample_rate(0),
+    d_readahead_ms(readahead_ms),
+    d_ring_buf(NULL),
+    d_reading(false),
+    d_connected(false),
+    d_overruns(0),
+    d_dropped(0),
+    d_reconnects(0),
+    d_popped(0),
+    d_gap_items(0)
 {
   int ret = 0;
 #if defined(USING_WINSOCK) // for Windows (with MinGW)
@@ -119,47 +338,112 @@ rtl_tcp_source_f::rtl_tcp_source_f(size_t itemsize,
   char port_str[12];
   sprintf( port_str, "%d", port );
 
-  // FIXME leaks if report_error throws below
   ret = getaddrinfo( host, port_str, &hints, &ip_src );
   if( ret != 0 )
     report_error("rtl_tcp_source_f/getaddrinfo",
                  "can't initialize source socket" );
 
-  // FIXME leaks if report_error throws below
-  d_temp_buff = new unsigned char[d_payload_size];   // allow it to hold up to payload_size bytes
-
-  d_LUT = new gr_complex[0xffff+1];
-  // create a lookup table for gr_complex values
-  for (unsigned int i = 0; i <= 0xffff; i++) {
-#ifdef BOOST_LITTLE_ENDIAN
-    d_LUT[i] = gr_complex( (float(i >> 8) - 127.4f) * (1.0f/128.0f),
-                                (float(i & 0xff) - 127.4f) * (1.0f/128.0f) );
-#else // BOOST_BIG_ENDIAN
-    d_LUT[i] = gr_complex( (float(i & 0xff) - 127.4f) * (1.0f/128.0f),
-                                (float(i >> 8) - 127.4f) * (1.0f/128.0f) );
+  d_host = std::string(host) + ":" + port_str;
+  memcpy( &d_addr, ip_src->ai_addr, ip_src->ai_addrlen );
+  d_addrlen = ip_src->ai_addrlen;
+  freeaddrinfo(ip_src);
+
+  // up to payload_size bytes, behind a partial delta block
+  d_temp_buff = new unsigned char[d_payload_size + DELTA_MAX_BLOCK];
+
+  // The server may not be up yet. Back off between the attempts instead
+  // of hammering it with connects.
+  int backoff = RECONNECT_MIN_MS;
+  while((d_socket = open_connection(false)) == -1) {
+    if (RECONNECT_MIN_MS == backoff)
+      fprintf(stderr, "rtl_tcp_source_f: waiting for the server at %s\n", d_host.c_str());
+
+    boost::this_thread::sleep(boost::posix_time::milliseconds(backoff));
+    backoff = std::min(backoff * 2, RECONNECT_MAX_MS);
+  }
+
+  if (d_format != format)
+    fprintf(stderr, "rtl_tcp_source_f: the server does not offer the %s format, "
+                    "using %s\n", rtl_tcp_format_name(format),
+            rtl_tcp_format_name(d_format));
+
+  d_sample_bytes = RTL_TCP_FORMAT_CU4 == d_format ? 1 :
+                   RTL_TCP_FORMAT_CS16 == d_format ? 4 : 2;
+
+  d_connected = true;
+}
+
+rtl_tcp_source_f_sptr make_rtl_tcp_source_f (size_t itemsize,
+                                             const char *ipaddr,
+                                             unsigned short port,
+                                             int payload_size,
+                                             bool eof,
+                                             bool wait,
+                                             int readahead_ms,
+                                             int rcvbuf,
+                                             bool reconnect,
+                                             rtl_tcp_gap_mode gap,
+                                             rtl_tcp_format format,
+                                             int decim)
+{
+  return gnuradio::get_initial_sptr(new rtl_tcp_source_f (
+                                      itemsize,
+                                      ipaddr,
+                                      port,
+                                      payload_size,
+                                      eof,
+                                      wait,
+                                      readahead_ms,
+                                      rcvbuf,
+                                      reconnect,
+                                      gap,
+                                      format,
+                                      decim));
+}
+
+rtl_tcp_source_f::~rtl_tcp_source_f ()
+{
+  stop();
+
+  delete [] d_temp_buff;
+  delete [] d_ring_buf;
+
+  if (d_socket != -1){
+    close_socket(d_socket);
+    d_socket = -1;
+  }
+
+#if defined(USING_WINSOCK) // for Windows (with MinGW)
+  // free winsock resources
+  WSACleanup();
 #endif
-   }
+}
 
-  // create socket
-  d_socket = socket(ip_src->ai_family, ip_src->ai_socktype,
-                    ip_src->ai_protocol);
-  if(d_socket == -1) {
-    report_error("socket open","can't open socket");
+/*
+ * Connects with a bounded wait and reads the dongle info, returns the new
+ * socket or -1. From the reader thread it gives up as soon as we stop.
+ */
+int rtl_tcp_source_f::open_connection(bool in_reader)
+{
+  int fd = socket(d_addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+  if(fd == -1) {
+    report_error("socket open", in_reader ? NULL : "can't open socket");
+    return -1;
   }
 
   // Turn on reuse address
   int opt_val = 1;
-  if(setsockopt(d_socket, SOL_SOCKET, SO_REUSEADDR, (optval_t)&opt_val, sizeof(int)) == -1) {
-    report_error("SO_REUSEADDR","can't set socket option SO_REUSEADDR");
+  if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (optval_t)&opt_val, sizeof(int)) == -1) {
+    report_error("SO_REUSEADDR", NULL);
   }
 
   // Don't wait when shutting down
   linger lngr;
   lngr.l_onoff  = 1;
   lngr.l_linger = 0;
-  if(setsockopt(d_socket, SOL_SOCKET, SO_LINGER, (optval_t)&lngr, sizeof(linger)) == -1) {
+  if(setsockopt(fd, SOL_SOCKET, SO_LINGER, (optval_t)&lngr, sizeof(linger)) == -1) {
     if( !is_error(ENOPROTOOPT) ) {  // no SO_LINGER for SOCK_DGRAM on Windows
-      report_error("SO_LINGER","can't set socket option SO_LINGER");
+      report_error("SO_LINGER", NULL);
     }
   }
 
@@ -174,70 +458,388 @@ rtl_tcp_source_f::rtl_tcp_source_f(size_t itemsize,
   timeout.tv_sec = 1;
   timeout.tv_usec = 0;
 #endif
-  if(setsockopt(d_socket, SOL_SOCKET, SO_RCVTIMEO, (optval_t)&timeout, sizeof(timeout)) == -1) {
-    report_error("SO_RCVTIMEO","can't set socket option SO_RCVTIMEO");
+  if(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (optval_t)&timeout, sizeof(timeout)) == -1) {
+    report_error("SO_RCVTIMEO", NULL);
   }
 #endif // USE_RCV_TIMEO
 
-  while(connect(d_socket, ip_src->ai_addr, ip_src->ai_addrlen) != 0);
-  freeaddrinfo(ip_src);
+  // Has to be set before connecting, the window scale is negotiated then.
+  // Linux stops autotuning the buffer once it is set, rcvbuf=0 avoids that.
+  if(d_rcvbuf > 0) {
+    if(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (optval_t)&d_rcvbuf, sizeof(int)) == -1) {
+      report_error("SO_RCVBUF", NULL);
+    }
+
+    int actual = 0;
+    socklen_t optlen = sizeof(actual);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, (optval_t)&actual, &optlen);
+#if defined(__linux__)
+    actual /= 2; // Linux reports twice what it grants, for its bookkeeping
+#endif
+    if(actual < d_rcvbuf && !in_reader)
+      fprintf(stderr, "rtl_tcp_source_f: receive buffer limited to %d bytes, "
+                      "consider raising net.core.rmem_max\n", actual);
+  }
+
+  // A blocking connect to an unreachable host hangs for minutes
+  set_nonblocking(fd, true);
+
+  int ret = connect(fd, (const sockaddr *)&d_addr, d_addrlen);
+  if (ret != 0 && is_in_progress()) {
+    for (int waited = 0; waited < CONNECT_TIMEOUT_USEC; waited += RX_WAIT_USEC) {
+      if (in_reader && !d_reading)
+        break;
+
+      ret = wait_socket(fd, true, RX_WAIT_USEC);
+      if (ret != 0)
+        break;
+    }
+
+    if (ret > 0) {
+      int err = 0;
+      socklen_t optlen = sizeof(err);
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, (optval_t)&err, &optlen);
+      ret = err ? -1 : 0;
+    } else {
+      ret = -1;
+    }
+  }
+
+  set_nonblocking(fd, false);
+
+  if (ret != 0) {
+    close_socket(fd);
+    return -1;
+  }
 
   int flag = 1;
-  setsockopt(d_socket, IPPROTO_TCP, TCP_NODELAY, (char *)&flag,sizeof(flag));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag,sizeof(flag));
+
+  if (RTL_TCP_FORMAT_CU8 != d_format)
+    send_raw(fd, CMD_SET_FORMAT, d_decim << 8 | d_format);
 
   dongle_info_t dongle_info;
-  ret = recv(d_socket, (char*)&dongle_info, sizeof(dongle_info), 0);
-  if (sizeof(dongle_info) != ret)
+  memset(&dongle_info, 0, sizeof(dongle_info));
+  if (!recv_all(fd, &dongle_info, sizeof(dongle_info))) {
+    // a listener that closes on us right away is no server yet
+    if (in_reader) {
+      close_socket(fd);
+      return -1;
+    }
+
     fprintf(stderr,"failed to read dongle info\n");
+  }
 
-  d_tuner_type = RTLSDR_TUNER_UNKNOWN;
-  d_tuner_gain_count = 0;
-  d_tuner_if_gain_count = 0;
+  unsigned int tuner_type = RTLSDR_TUNER_UNKNOWN;
+  unsigned int tuner_gain_count = 0;
+  rtl_tcp_format format = RTL_TCP_FORMAT_CU8;
+  int decim = 1;
 
-  if (memcmp(dongle_info.magic, "RTL0", 4) == 0)
+  if (memcmp(dongle_info.magic, "RTL0", 4) == 0 ||
+      memcmp(dongle_info.magic, "RTLX", 4) == 0)
   {
-    d_tuner_type = ntohl(dongle_info.tuner_type);
-    d_tuner_gain_count = ntohl(dongle_info.tuner_gain_count);
-    if ( RTLSDR_TUNER_E4000 == d_tuner_type )
-      d_tuner_if_gain_count = 53;
+    tuner_type = ntohl(dongle_info.tuner_type);
+    tuner_gain_count = ntohl(dongle_info.tuner_gain_count);
+  }
+
+  if (memcmp(dongle_info.magic, "RTLX", 4) == 0) {
+    uint32_t agreed[2] = { 0, 0 };
+
+    if (!recv_all(fd, agreed, sizeof(agreed)) ||
+        ntohl(agreed[0]) > RTL_TCP_FORMAT_DELTA || ntohl(agreed[1]) < 1) {
+      fprintf(stderr, "rtl_tcp_source_f: invalid format reply\n");
+      close_socket(fd);
+      if (!in_reader)
+        throw std::runtime_error("can't agree on a wire format");
+      return -1;
+    }
+
+    format = (rtl_tcp_format)ntohl(agreed[0]);
+    decim = RTL_TCP_FORMAT_CS16 == format ? ntohl(agreed[1]) : 1;
   }
+
+  if (in_reader) {
+    // the gain tables were handed out already, all we can do is tell
+    if (tuner_type != d_tuner_type)
+      fprintf(stderr, "rtl_tcp_source_f: the server now reports a different tuner\n");
+
+    // but the samples in the ring are in the old format
+    if (format != d_format || decim != d_decim) {
+      fprintf(stderr, "rtl_tcp_source_f: the server now sends %s, not %s\n",
+              rtl_tcp_format_name(format), rtl_tcp_format_name(d_format));
+      close_socket(fd);
+      return -1;
+    }
+  } else {
+    d_tuner_type = tuner_type;
+    d_tuner_gain_count = tuner_gain_count;
+    d_tuner_if_gain_count = RTLSDR_TUNER_E4000 == tuner_type ? 53 : 0;
+    d_format = format;
+    d_decim = decim;
+  }
+
+  return fd;
 }
 
-rtl_tcp_source_f_sptr make_rtl_tcp_source_f (size_t itemsize,
-                                             const char *ipaddr,
-                                             unsigned short port,
-                                             int payload_size,
-                                             bool eof,
-                                             bool wait)
+void rtl_tcp_source_f::close_connection()
 {
-  return gnuradio::get_initial_sptr(new rtl_tcp_source_f (
-                                      itemsize,
-                                      ipaddr,
-                                      port,
-                                      payload_size,
-                                      eof,
-                                      wait));
+  boost::mutex::scoped_lock lock(d_cmd_mutex);
+
+  if (d_socket != -1) {
+    close_socket(d_socket);
+    d_socket = -1;
+  }
 }
 
-rtl_tcp_source_f::~rtl_tcp_source_f ()
+/*
+ * Retries with exponential backoff until the server is back or we stop,
+ * then replays the settings and queues the outage for work(). Returns
+ * false if we were stopped first.
+ */
+bool rtl_tcp_source_f::reconnect(uint64_t &pushed)
 {
-  delete [] d_temp_buff;
-  delete [] d_LUT;
+  using namespace boost::posix_time;
 
-  if (d_socket != -1){
-    shutdown(d_socket, SHUT_RDWR);
-#if defined(USING_WINSOCK)
-    closesocket(d_socket);
-#else
-    ::close(d_socket);
-#endif
-    d_socket = -1;
+  ptime down = microsec_clock::universal_time();
+  int backoff = RECONNECT_MIN_MS;
+  int fd;
+
+  fprintf(stderr, "rtl_tcp_source_f: reconnecting to %s\n", d_host.c_str());
+
+  while ((fd = open_connection(true)) == -1) {
+    for (int slept = 0; slept < backoff; slept += RX_WAIT_USEC / 1000) {
+      if (!d_reading)
+        return false;
+      boost::this_thread::sleep(microseconds(RX_WAIT_USEC));
+    }
+
+    backoff = std::min(backoff * 2, RECONNECT_MAX_MS);
   }
 
-#if defined(USING_WINSOCK) // for Windows (with MinGW)
-  // free winsock resources
-  WSACleanup();
+  // the last sample before the outage may have been cut short, fill it
+  // up with silence: zero for cs16, the midpoint for the cu8 bytes
+  unsigned char pad = RTL_TCP_FORMAT_CS16 == d_format ? 0 : 0x80;
+  while (pushed % d_sample_bytes) {
+    if (!d_reading) {
+      close_socket(fd);
+      return false;
+    }
+
+    if (!d_ring.space()) {
+      d_ring.wait_space(1, 0, RX_WAIT_USEC);
+      continue;
+    }
+
+    d_ring_buf[d_ring.tail()] = pad;
+    d_ring.push(1);
+    pushed++;
+  }
+
+  double seconds = (microsec_clock::universal_time() - down).total_microseconds() * 1e-6;
+  uint64_t lost = uint64_t(seconds * d_sample_rate);
+
+  d_dropped += lost;
+
+  if (RTL_TCP_GAP_DROP != d_gap) {
+    gap_t gap = { pushed, lost };
+
+    boost::mutex::scoped_lock lock(d_gap_mutex);
+    d_gaps.push_back(gap);
+  }
+
+  {
+    boost::mutex::scoped_lock lock(d_cmd_mutex);
+
+    d_socket = fd;
+    for (size_t i = 0; i < d_commands.size(); i++)
+      send_raw(d_socket, d_commands[i].first, d_commands[i].second);
+  }
+
+  d_reconnects++;
+
+  fprintf(stderr, "rtl_tcp_source_f: reconnected after %.1f s\n", seconds);
+
+  return true;
+}
+
+bool rtl_tcp_source_f::start()
+{
+  int rate = d_sample_rate;
+  if (rate <= 0)
+    rate = MAX_SAMPLE_RATE;
+
+  // whole samples (or delta blocks), so none gets split around the wrap
+  size_t unit = RTL_TCP_FORMAT_DELTA == d_format ? DELTA_BLOCK_BYTES : d_sample_bytes;
+  size_t size = size_t(double(rate) * d_sample_bytes * d_readahead_ms / 1000);
+  size = std::max(size, size_t(d_payload_size) * 2);
+  size -= size % unit;
+
+  if (!d_ring_buf || size != d_ring.capacity()) {
+    delete [] d_ring_buf;
+    d_ring_buf = new unsigned char[size];
+  }
+
+  d_ring.reset(size);
+
+  d_popped = 0;
+  d_gap_items = 0;
+  d_gaps.clear();
+
+  d_reading = true;
+  d_thread = gr::thread::thread(boost::bind(&rtl_tcp_source_f::reader_task, this));
+
+  return true;
+}
+
+bool rtl_tcp_source_f::stop()
+{
+  if (!d_thread.joinable())
+    return true;
+
+  d_reading = false;
+  d_ring.stop();
+  d_thread.join();
+
+  if (d_overruns || d_reconnects)
+    fprintf(stderr, "rtl_tcp_source_f: %lu overruns, %lu reconnects, %llu samples dropped\n",
+            (unsigned long)d_overruns, (unsigned long)d_reconnects,
+            (unsigned long long)d_dropped);
+
+  return true;
+}
+
+/*
+ * Decodes the complete delta blocks staged in d_temp_buff into the ring,
+ * or drops them if it is full. Returns the length of the partial block
+ * left at the front, or -1 if the stream makes no sense.
+ */
+size_t rtl_tcp_source_f::decode_blocks(size_t staged, uint64_t &pushed, bool &overrun)
+{
+  size_t pos = 0;
+
+  while (pos < staged) {
+    if (d_temp_buff[pos] > 8)
+      return size_t(-1);
+
+    size_t len = delta_block_size(d_temp_buff[pos]);
+    if (pos + len > staged)
+      break;
+
+    if (d_ring.space() >= DELTA_BLOCK_BYTES) {
+      overrun = false;
+      delta_decode(d_temp_buff + pos, d_ring_buf + d_ring.tail());
+      d_ring.push(DELTA_BLOCK_BYTES);
+      pushed += DELTA_BLOCK_BYTES;
+    } else {
+      if (!overrun)
+        d_overruns++;
+      overrun = true;
+      d_dropped += DELTA_BLOCK_BYTES / 2;
+    }
+
+    pos += len;
+  }
+
+  memmove(d_temp_buff, d_temp_buff + pos, staged - pos);
+
+  return staged - pos;
+}
+
+/*
+ * Keeps the socket drained while the scheduler is busy elsewhere. When
+ * the ring is full we read on and drop, so the overrun shows up in our
+ * counters instead of stalling the server. Drops are kept to whole
+ * samples so I and Q stay in place.
+ */
+void rtl_tcp_source_f::reader_task()
+{
+  const size_t sb = d_sample_bytes;
+  uint64_t pushed = 0;
+  uint64_t dropped_bytes = 0;
+  size_t staged = 0;
+  bool overrun = false;
+
+  while (d_reading) {
+    if (d_socket == -1) {
+      if (!d_reconnect || !reconnect(pushed))
+        break;
+
+      // the server starts over with a whole sample
+      dropped_bytes += (sb - dropped_bytes % sb) % sb;
+      staged = 0;
+      overrun = false;
+      continue;
+    }
+
+#if USE_SELECT
+    int ret = wait_socket(d_socket, false, RX_WAIT_USEC);
+    if (ret == 0 || (ret < 0 && is_transient_error()))
+      continue;
+
+    if (ret < 0) {
+      report_error("rtl_tcp_source_f/select", NULL);
+      close_connection();
+      continue;
+    }
 #endif
+
+    size_t space = d_ring.space();
+    unsigned char *dst = d_temp_buff;
+    size_t len = d_payload_size;
+    bool drop = true;
+
+    if (RTL_TCP_FORMAT_DELTA == d_format) {
+      dst = d_temp_buff + staged; // decoded into the ring below
+      drop = false;
+    } else if (space && (dropped_bytes % sb)) {
+      len = sb - dropped_bytes % sb; // realign after a partial sample
+    } else if (space) {
+      size_t tail = d_ring.tail();
+      dst = d_ring_buf + tail;
+      len = std::min(std::min(space, d_ring.capacity() - tail), size_t(d_payload_size));
+      drop = false;
+    }
+
+    ssize_t received = recv(d_socket, (char*)dst, len, 0);
+
+    if (received < 0 && is_transient_error())
+      continue;
+
+    if (received <= 0) {
+      if (received == 0)
+        fprintf(stderr, "rtl_tcp_source_f: server closed the connection\n");
+      else
+        report_error("rtl_tcp_source_f/recv", NULL);
+      close_connection();
+      continue;
+    }
+
+    if (RTL_TCP_FORMAT_DELTA == d_format) {
+      staged = decode_blocks(staged + received, pushed, overrun);
+
+      if (size_t(-1) == staged) {
+        fprintf(stderr, "rtl_tcp_source_f: corrupt delta block\n");
+        close_connection();
+        staged = 0;
+      }
+    } else if (drop) {
+      if (!overrun)
+        d_overruns++;
+      overrun = true;
+
+      d_dropped += (dropped_bytes + received) / sb - dropped_bytes / sb;
+      dropped_bytes += received;
+    } else {
+      overrun = false;
+      d_ring.push(received);
+      pushed += received;
+    }
+  }
+
+  if (d_reading)
+    d_connected = false;
+
+  d_ring.stop();
 }
 
 int rtl_tcp_source_f::work (int noutput_items,
@@ -245,101 +847,148 @@ int rtl_tcp_source_f::work (int noutput_items,
                             gr_vector_void_star &output_items)
 {
   gr_complex *out = (gr_complex *) output_items[0];
-  size_t remaining = 0;
 
-  int bytesleft;
+  // everything from before the outage is out, account for the outage now
+  if (RTL_TCP_GAP_DROP != d_gap) {
+    boost::mutex::scoped_lock lock(d_gap_mutex);
+
+    if (!d_gaps.empty() && d_gaps.front().pos <= d_popped) {
+      if (RTL_TCP_GAP_ZERO == d_gap)
+        d_gap_items += d_gaps.front().samples;
+#ifndef ENABLE_RUNTIME
+      else
+        add_item_tag(0, nitems_written(0), DROPPED_KEY,
+                     pmt::from_uint64(d_gaps.front().samples), alias_pmt());
+#endif
+      d_gaps.pop_front();
+    }
+  }
 
-  if( noutput_items * 2 < d_payload_size) {
-    bytesleft = noutput_items * 2;
-    remaining = noutput_items;
-  } else {
-    remaining = d_payload_size >> 1;
-    bytesleft = d_payload_size;
+  if (d_gap_items) {
+    size_t count = std::min(d_gap_items, uint64_t(noutput_items));
+
+    std::fill(out, out + count, gr_complex(0, 0));
+    d_gap_items -= count;
+
+    return count;
   }
 
-  int index = 0;
-  int receivedbytes = 0;
-  while(bytesleft > 0) {
-    receivedbytes = recv(d_socket, (char*)&d_temp_buff[index], bytesleft, 0);
+  const size_t sb = d_sample_bytes;
 
-    if(receivedbytes == -1 && !is_error(EAGAIN)){
-      fprintf(stderr, "socket error\n");
+  if (d_ring.size() < sb) {
+    if (!d_connected)
       return -1;
-    }
-    bytesleft -= receivedbytes;
-    index += receivedbytes;
+
+    d_ring.wait(sb, 0, RX_WAIT_USEC);
+  }
+
+  // only what is already here, in whole samples
+  size_t nbytes = d_ring.size();
+  nbytes = std::min(size_t(noutput_items) * sb, nbytes - nbytes % sb);
+
+  // and only up to the next outage
+  if (RTL_TCP_GAP_DROP != d_gap) {
+    boost::mutex::scoped_lock lock(d_gap_mutex);
+
+    if (!d_gaps.empty())
+      nbytes = std::min(nbytes, size_t(d_gaps.front().pos - d_popped));
   }
-  remaining = noutput_items;
 
-  for(size_t i = 0; i < remaining; ++i)
-    out[i] = d_LUT[*(((unsigned short*)d_temp_buff)+i)];
+  size_t head = d_ring.head();
+  size_t first = std::min(nbytes, d_ring.capacity() - head);
 
-  return remaining;
+  convert(d_ring_buf + head, out, first / sb);
+  convert(d_ring_buf, out + first / sb, (nbytes - first) / sb);
+
+  d_ring.pop(nbytes);
+  d_popped += nbytes;
+
+  return nbytes / sb;
 }
 
-#ifdef _WIN32
-#define __attribute__(x)
-#pragma pack(push, 1)
-#endif
-struct command{
-  unsigned char cmd;
-  unsigned int param;
-}__attribute__((packed));
-#ifdef _WIN32
-#pragma pack(pop)
-#endif
+void rtl_tcp_source_f::convert(const unsigned char *in, gr_complex *out, size_t nsamples)
+{
+  switch (d_format) {
+  case RTL_TCP_FORMAT_CU4:
+    convert_cu4_to_cf32(in, out, nsamples, CU4_LEVELS, 1.0f/128.0f);
+    break;
+  case RTL_TCP_FORMAT_CS16:
+    convert_cs16_to_cf32(in, out, nsamples, 1.0f/32768.0f);
+    break;
+  default: // delta blocks are cu8 once decoded
+    convert_cu8_to_cf32(in, out, nsamples, 127.4f, 1.0f/128.0f);
+    break;
+  }
+}
+
+/*
+ * Remembers the last value per command, per stage for the IF gains, in
+ * the order they were given. Nothing is sent while we are reconnecting,
+ * the replay brings the server up to date.
+ */
+void rtl_tcp_source_f::send_command(unsigned char code, unsigned int param)
+{
+  boost::mutex::scoped_lock lock(d_cmd_mutex);
+
+  for (size_t i = 0; i < d_commands.size(); i++) {
+    if (d_commands[i].first == code &&
+        (0x06 != code || (d_commands[i].second >> 16) == (param >> 16))) {
+      d_commands.erase(d_commands.begin() + i);
+      break;
+    }
+  }
+
+  d_commands.push_back(std::make_pair(code, param));
+
+  if (d_socket != -1)
+    send_raw(d_socket, code, param);
+}
 
 void rtl_tcp_source_f::set_freq(int freq)
 {
-  struct command cmd = { 0x01, htonl(freq) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x01, freq);
 }
 
+// the rate we deliver, the dongle runs faster if the server decimates
 void rtl_tcp_source_f::set_sample_rate(int sample_rate)
 {
-  struct command cmd = { 0x02, htonl(sample_rate) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x02, sample_rate * d_decim);
+
+  d_sample_rate = sample_rate;
 }
 
 void rtl_tcp_source_f::set_gain_mode(int manual)
 {
-  struct command cmd = { 0x03, htonl(manual) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x03, manual);
 }
 
 void rtl_tcp_source_f::set_gain(int gain)
 {
-  struct command cmd = { 0x04, htonl(gain) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x04, gain);
 }
 
 void rtl_tcp_source_f::set_freq_corr(int ppm)
 {
-  struct command cmd = { 0x05, htonl(ppm) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x05, ppm);
 }
 
 void rtl_tcp_source_f::set_if_gain(int stage, int gain)
 {
   uint32_t params = stage << 16 | (gain & 0xffff);
-  struct command cmd = { 0x06, htonl(params) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x06, params);
 }
 
 void rtl_tcp_source_f::set_agc_mode(int on)
 {
-  struct command cmd = { 0x08, htonl(on) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x08, on);
 }
 
 void rtl_tcp_source_f::set_direct_sampling(int on)
 {
-  struct command cmd = { 0x09, htonl(on) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x09, on);
 }
 
 void rtl_tcp_source_f::set_offset_tuning(int on)
 {
-  struct command cmd = { 0x0a, htonl(on) };
-  send(d_socket, (const char*)&cmd, sizeof(cmd), 0);
+  send_command(0x0a, on);
 }
@@ -24,6 +24,14 @@
 #include <gnuradio/sync_block.h>
 #include <gnuradio/thread/thread.h>
 
+#include <boost/atomic.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "spsc_ring.h"
+
 #if defined(_WIN32)
 // if not posix, assume winsock
 #pragma comment(lib, "ws2_32.lib")
@@ -58,6 +66,24 @@ enum rtlsdr_tuner {
   RTLSDR_TUNER_R828D
 };
 
+/* what work() does about the samples missed while reconnecting */
+enum rtl_tcp_gap_mode {
+  RTL_TCP_GAP_DROP = 0,   /* carry on with what the server sends next */
+  RTL_TCP_GAP_ZERO,       /* stand in zeros for the length of the outage */
+  RTL_TCP_GAP_TAG         /* carry on, mark the outage with an rx_dropped tag */
+};
+
+/* how the samples travel, anything but cu8 has to be offered by the server */
+enum rtl_tcp_format {
+  RTL_TCP_FORMAT_CU8 = 0, /* 8 bit unsigned I/Q, what every server sends */
+  RTL_TCP_FORMAT_CU4,     /* 4 bit companded I/Q, one byte per sample */
+  RTL_TCP_FORMAT_CS16,    /* 16 bit I/Q, decimated by the server */
+  RTL_TCP_FORMAT_DELTA    /* cu8 in blocks of bit packed deltas */
+};
+
+/* the name the format goes by in the device arguments */
+const char *rtl_tcp_format_name(rtl_tcp_format format);
+
 class rtl_tcp_source_f;
 typedef boost::shared_ptr<rtl_tcp_source_f> rtl_tcp_source_f_sptr;
 
@@ -67,7 +93,13 @@ rtl_tcp_source_f_sptr make_rtl_tcp_source_f (
     unsigned short port,
     int payload_size,
     bool eof = false,
-    bool wait = false);
+    bool wait = false,
+    int readahead_ms = 250,
+    int rcvbuf = 4*1024*1024,
+    bool reconnect = true,
+    rtl_tcp_gap_mode gap = RTL_TCP_GAP_DROP,
+    rtl_tcp_format format = RTL_TCP_FORMAT_CU8,
+    int decim = 1);
 
 class rtl_tcp_source_f : public gr::sync_block
 {
@@ -76,17 +108,66 @@ private:
   int           d_payload_size;  // maximum transmission unit (packet length)
   bool          d_eof;           // zero-length packet is EOF
   bool          d_wait;          // wait if data if not immediately available
-  int           d_socket;        // handle to socket
-  unsigned char *d_temp_buff;    // hold buffer between calls
-  gr_complex    *d_LUT;
+  int           d_socket;        // handle to socket, -1 while reconnecting
+  unsigned char *d_temp_buff;    // receives the bytes we have to drop
+
+  std::string   d_host;
+  sockaddr_storage d_addr;       // resolved once, reused for reconnecting
+  socklen_t     d_addrlen;
+  int           d_rcvbuf;
+  bool          d_reconnect;     // reconnect instead of ending the stream
+  rtl_tcp_gap_mode d_gap;
+  rtl_tcp_format d_format;       // as agreed on with the server
+  int           d_decim;         // server side decimation for cs16
+  size_t        d_sample_bytes;  // per complex sample in the ring
 
   unsigned int d_tuner_type;
   unsigned int d_tuner_gain_count;
   unsigned int d_tuner_if_gain_count;
 
+  boost::atomic<int> d_sample_rate; // last rate sent to the server, 0 if none
+  int           d_readahead_ms;  // sizes the ring at start()
+
+  // raw I/Q bytes from the reader thread, one byte per slot
+  unsigned char *d_ring_buf;
+  spsc_ring     d_ring;
+
+  gr::thread::thread d_thread;
+  boost::atomic<bool> d_reading;
+  boost::atomic<bool> d_connected;
+
+  boost::atomic<unsigned long> d_overruns;
+  boost::atomic<uint64_t> d_dropped;
+  boost::atomic<unsigned long> d_reconnects;
+
+  // the last value of every command, replayed after reconnecting
+  boost::mutex d_cmd_mutex;      // also guards swapping d_socket
+  std::vector< std::pair<unsigned char, unsigned int> > d_commands;
+
+  // outages by their position in the byte stream, queued by the reader
+  struct gap_t {
+    uint64_t pos;
+    uint64_t samples;
+  };
+
+  boost::mutex  d_gap_mutex;
+  std::deque<gap_t> d_gaps;
+  uint64_t      d_popped;        // bytes work() took from the ring
+  uint64_t      d_gap_items;     // zeros still owed for an outage
+
+  int open_connection(bool in_reader);
+  void close_connection();
+  bool reconnect(uint64_t &pushed);
+  void send_command(unsigned char cmd, unsigned int param);
+  size_t decode_blocks(size_t staged, uint64_t &pushed, bool &overrun);
+  void convert(const unsigned char *in, gr_complex *out, size_t nsamples);
+  void reader_task();
+
 private:
   rtl_tcp_source_f(size_t itemsize, const char *host,
-                   unsigned short port, int payload_size, bool eof, bool wait);
+                   unsigned short port, int payload_size, bool eof, bool wait,
+                   int readahead_ms, int rcvbuf, bool reconnect,
+                   rtl_tcp_gap_mode gap, rtl_tcp_format format, int decim);
 
   // The friend declaration allows make_source_c to
   // access the private constructor.
@@ -96,7 +177,13 @@ private:
       unsigned short port,
       int payload_size,
       bool eof,
-      bool wait);
+      bool wait,
+      int readahead_ms,
+      int rcvbuf,
+      bool reconnect,
+      rtl_tcp_gap_mode gap,
+      rtl_tcp_format format,
+      int decim);
 
 public:
   ~rtl_tcp_source_f();
@@ -105,6 +192,19 @@ public:
   unsigned int get_tuner_gain_count() { return d_tuner_gain_count; }
   unsigned int get_tuner_if_gain_count() { return d_tuner_if_gain_count; }
 
+  // the wire format the server agreed to, cu8 for a classic server
+  enum rtl_tcp_format get_format() { return d_format; }
+  int get_decimation() { return d_decim; }
+
+  // times the ring ran full, the samples dropped then or missed while
+  // reconnecting, and how often we had to reconnect
+  unsigned long get_overruns() { return d_overruns; }
+  uint64_t get_dropped_samples() { return d_dropped; }
+  unsigned long get_reconnects() { return d_reconnects; }
+
+  bool start();
+  bool stop();
+
   int work(int noutput_items,
            gr_vector_const_void_star &input_items,
            gr_vector_void_star &output_items);
@@ -35,6 +35,7 @@
 
 #include <boost/assign.hpp>
 #include <boost/format.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <stdexcept>
 #include <iostream>
@@ -44,6 +45,7 @@
 #include <mirsdrapi-rsp.h>
 
 #include "arg_helpers.h"
+#include "convert.h"
 
 #define MAX_SUPPORTED_DEVICES   4
 
@@ -81,6 +83,7 @@ using namespace boost::assign;
 #define SDRPLAY_FREQ_MAX  1849e6
 #define SDRPLAY_SAMPLERATE_MIN 1024e3
 #define SDRPLAY_SCALE (1.0f/32768)
+#define SDRPLAY_FIFO_DURATION 0.25 // seconds of samples the reader may run ahead
 
 /*
  * Create a new instance of sdrplay_source_c and return
@@ -113,8 +116,13 @@ sdrplay_source_c::sdrplay_source_c (const std::string &args)
   : gr::sync_block ("sdrplay_source_c",
         gr::io_signature::make(MIN_IN, MAX_IN, sizeof (gr_complex)),
         gr::io_signature::make(MIN_OUT, MAX_OUT, sizeof (gr_complex))),
+    _fifo(NULL),
+    _reading(false),
     _running(false),
-    _uninit(false),
+    _restart(false),
+    _flush(false),
+    _overflows(0),
+    _dropped(0),
     _auto_gain(false)
 {
    _dev = (sdrplay_dev_t *)malloc(sizeof(sdrplay_dev_t));
@@ -132,12 +140,8 @@ sdrplay_source_c::sdrplay_source_c (const std::string &args)
    set_gain_limits(_dev->rfHz);
    _dev->gain_dB = _dev->maxGain - _dev->gRdB;
    
-   _bufi.reserve(SDRPLAY_MAX_BUF_SIZE);
-   _bufq.reserve(SDRPLAY_MAX_BUF_SIZE);   
-
-   _buf_mutex.lock();
-   _buf_offset = 0;
-   _buf_mutex.unlock();
+   _bufi.resize(SDRPLAY_MAX_BUF_SIZE);
+   _bufq.resize(SDRPLAY_MAX_BUF_SIZE);
 }
 
 /*
@@ -145,28 +149,161 @@ sdrplay_source_c::sdrplay_source_c (const std::string &args)
  */
 sdrplay_source_c::~sdrplay_source_c ()
 {
+   if (_reading)
+   {
+      stop();
+   }
+
+   delete[] _fifo;
+   _fifo = NULL;
+
    free(_dev);
    _dev = NULL;
-   _buf_mutex.lock();
+}
+
+bool sdrplay_source_c::start()
+{
+   if (_dev == NULL)
+   {
+      return false;
+   }
+
+   /* sized for the current rate, a later rate change only shortens the headroom */
+   size_t capacity = std::max( size_t(_dev->fsHz * SDRPLAY_FIFO_DURATION), size_t(1 << 16) );
+
+   if ( ! _fifo || capacity != _fifo_ring.capacity() )
+   {
+      delete[] _fifo;
+      _fifo = new gr_complex[ capacity ];
+   }
+
+   _fifo_ring.reset( capacity );
+   _flush = false;
+   _restart = false;
+
+   _reading = true;
+   _thread = gr::thread::thread(_sdrplay_reader, this);
+
+   return true;
+}
+
+bool sdrplay_source_c::stop()
+{
+   _reading = false;
+   _fifo_ring.stop();
+   _thread.join();
+
+   if (_overflows)
+   {
+      std::cerr << "sdrplay: " << _overflows << " overflows, "
+                << _dropped << " samples dropped" << std::endl;
+   }
+
+   return true;
+}
+
+/*
+ * Everything that talks to the streaming side of the API runs on this
+ * thread: the (re)initialisation as well as mir_sdr_ReadPacket(), which
+ * blocks on USB. work() only ever drains the FIFO.
+ */
+void sdrplay_source_c::_sdrplay_reader(sdrplay_source_c *obj)
+{
+   obj->sdrplay_reader();
+}
+
+void sdrplay_source_c::sdrplay_reader()
+{
+   unsigned int sampNum;
+   int grChanged;
+   int rfChanged;
+   int fsChanged;
+
+   while (_reading)
+   {
+      if (!_running || _restart.exchange(false))
+      {
+         if (!reinit_device())
+         {
+            break;
+         }
+      }
+
+      if (mir_sdr_ReadPacket(_bufi.data(), _bufq.data(), &sampNum, &grChanged, &rfChanged, &fsChanged) != mir_sdr_Success)
+      {
+         std::cerr << "mir_sdr_ReadPacket failed" << std::endl;
+         break;
+      }
+
+      size_t num_samples = _dev->samplesPerPacket;
+      size_t to_copy = std::min(num_samples, _fifo_ring.space());
+
+      /* fill the FIFO in up to two segments around the wrap */
+      size_t tail = _fifo_ring.tail();
+      size_t first = std::min(to_copy, _fifo_ring.capacity() - tail);
+
+      convert_cs16_planar_to_cf32(&_bufi[0], &_bufq[0], _fifo + tail, first, SDRPLAY_SCALE);
+      convert_cs16_planar_to_cf32(&_bufi[first], &_bufq[first], _fifo, to_copy - first, SDRPLAY_SCALE);
+
+      if (to_copy)
+      {
+         _fifo_ring.push(to_copy);
+      }
+
+      if (to_copy < num_samples)
+      {
+         _overflows++;
+         _dropped += num_samples - to_copy;
+         std::cerr << "O" << std::flush;
+      }
+   }
+
+   _dev_mutex.lock();
    if (_running)
    {
       mir_sdr_Uninit();
       _running = false;
    }
-   _uninit = true;
-   _buf_mutex.unlock();
+   _dev_mutex.unlock();
+
+   /* let work() return instead of waiting for samples that never come */
+   _fifo_ring.stop();
 }
 
-void sdrplay_source_c::reinit_device()
+/*
+ * Called from the reader thread only. Samples still queued were taken
+ * with the old settings, work() drops them before returning new ones.
+ */
+bool sdrplay_source_c::reinit_device()
 {
+   mir_sdr_ErrT ret;
+
    std::cerr << "reinit_device started" << std::endl;
-   _buf_mutex.lock();
-   std::cerr << "after mutex.lock" << std::endl;
-   std::cerr << "mir_sdr_Uninit started" << std::endl;
-   mir_sdr_Uninit();
+   _dev_mutex.lock();
+
+   if (_running)
+   {
+      std::cerr << "mir_sdr_Uninit started" << std::endl;
+      mir_sdr_Uninit();
+      _running = false;
+   }
+
+   _flush = true;
 
    std::cerr << "mir_sdr_Init started" << std::endl;
-   mir_sdr_Init(_dev->gRdB, _dev->fsHz / 1e6, _dev->rfHz / 1e6, _dev->bwType, _dev->ifType, &_dev->samplesPerPacket);
+   ret = mir_sdr_Init(_dev->gRdB, _dev->fsHz / 1e6, _dev->rfHz / 1e6, _dev->bwType, _dev->ifType, &_dev->samplesPerPacket);
+
+   if (ret != mir_sdr_Success ||
+       _dev->samplesPerPacket <= 0 || _dev->samplesPerPacket > SDRPLAY_MAX_BUF_SIZE)
+   {
+      std::cerr << "mir_sdr_Init failed (" << ret << ")" << std::endl;
+      if (ret == mir_sdr_Success)
+      {
+         mir_sdr_Uninit();
+      }
+      _dev_mutex.unlock();
+      return false;
+   }
 
    if (_dev->dcMode)
    {
@@ -174,9 +311,17 @@ void sdrplay_source_c::reinit_device()
       mir_sdr_SetDcMode(4, 1);
    }
 
-   _buf_offset = 0;
-   _buf_mutex.unlock();
+   _running = true;
+   _dev_mutex.unlock();
    std::cerr << "reinit_device end" << std::endl;
+
+   return true;
+}
+
+/* hands a full reinitialisation over to the reader thread */
+void sdrplay_source_c::request_restart()
+{
+   _restart = true;
 }
 
 void sdrplay_source_c::set_gain_limits(double freq)
@@ -217,57 +362,28 @@ int sdrplay_source_c::work( int noutput_items,
                             gr_vector_void_star &output_items )
 {
    gr_complex *out = (gr_complex *)output_items[0];
-   int cnt = noutput_items;
-   unsigned int sampNum;
-   int grChanged;
-   int rfChanged;
-   int fsChanged;
 
-   if (_uninit)
+   /* the reader flags a restart before it pushes the first new packet */
+   if (_flush.exchange(false))
    {
-      return WORK_DONE;
+      _fifo_ring.pop(_fifo_ring.size());
    }
 
-   if (!_running)
+   if (!_fifo_ring.wait(1))
    {
-      reinit_device();
-      _running = true;
+      return WORK_DONE;
    }
 
-   _buf_mutex.lock();
+   size_t n_samples = std::min(size_t(noutput_items), _fifo_ring.size());
+   size_t head = _fifo_ring.head();
+   size_t first = std::min(n_samples, _fifo_ring.capacity() - head);
 
-   if (_buf_offset)
-   {
-      for (int i = _buf_offset; i < _dev->samplesPerPacket; i++)
-      {
-         *out++ = gr_complex( float(_bufi[i]) * SDRPLAY_SCALE, float(_bufq[i]) * SDRPLAY_SCALE );
-      }
-      cnt -= (_dev->samplesPerPacket - _buf_offset);
-   }
+   memcpy(out, _fifo + head, first * sizeof(gr_complex));
+   memcpy(out + first, _fifo, (n_samples - first) * sizeof(gr_complex));
 
-   while ((cnt - _dev->samplesPerPacket) >= 0)
-   {
-      mir_sdr_ReadPacket(_bufi.data(), _bufq.data(), &sampNum, &grChanged, &rfChanged, &fsChanged);
-      for (int i = 0; i < _dev->samplesPerPacket; i++)
-      {
-         *out++ = gr_complex( float(_bufi[i]) * SDRPLAY_SCALE, float(_bufq[i]) * SDRPLAY_SCALE );
-      }
-      cnt -= _dev->samplesPerPacket;
-   }
-
-   _buf_offset = 0;
-   if (cnt)
-   {
-      mir_sdr_ReadPacket(_bufi.data(), _bufq.data(), &sampNum, &grChanged, &rfChanged, &fsChanged);
-      for (int i = 0; i < cnt; i++)
-      {
-         *out++ = gr_complex( float(_bufi[i]) * SDRPLAY_SCALE, float(_bufq[i]) * SDRPLAY_SCALE );
-      }
-      _buf_offset = cnt;
-   }
-   _buf_mutex.unlock();
+   _fifo_ring.pop(n_samples);
 
-   return noutput_items;
+   return n_samples;
 }
 
 std::vector<std::string> sdrplay_source_c::get_devices()
@@ -320,6 +436,7 @@ osmosdr::meta_range_t sdrplay_source_c::get_sample_rates()
 double sdrplay_source_c::set_sample_rate(double rate)
 {
    std::cerr << "set_sample_rate start" << std::endl;
+   _dev_mutex.lock();
    double diff = rate - _dev->fsHz;
    _dev->fsHz = rate;
 
@@ -334,10 +451,10 @@ double sdrplay_source_c::set_sample_rate(double rate)
       }
       else
       {
-         std::cerr << "reinit_device started" << std::endl;
-         reinit_device();
+         request_restart();
       }
    }
+   _dev_mutex.unlock();
    std::cerr << "set_sample_rate end" << std::endl;
 
    return get_sample_rate();
@@ -367,6 +484,7 @@ double sdrplay_source_c::set_center_freq( double freq, size_t chan )
 {
    std::cerr << "set_center_freq start" << std::endl;
    std::cerr << "freq = " << freq << std::endl;
+   _dev_mutex.lock();
    double diff = freq - _dev->rfHz;
    std::cerr << "diff = " << diff << std::endl;
    _dev->rfHz = freq;
@@ -380,10 +498,10 @@ double sdrplay_source_c::set_center_freq( double freq, size_t chan )
       }
       else
       {
-         std::cerr << "reinit_device started" << std::endl;
-         reinit_device();
+         request_restart();
       }
    }
+   _dev_mutex.unlock();
 
    std::cerr << "set_center_freq end" << std::endl;
    return get_center_freq( chan );
@@ -471,11 +589,13 @@ double sdrplay_source_c::set_gain( double gain, size_t chan )
    }
    _dev->gRdB = (int)(_dev->maxGain - gain);
 
+   _dev_mutex.lock();
    if (_running) 
    {
       std::cerr << "mir_sdr_SetGr started" << std::endl;
       mir_sdr_SetGr(_dev->gRdB, 1, 0);
    }
+   _dev_mutex.unlock();
 
 std::cerr << "set_gain end" << std::endl;
 return get_gain( chan );
@@ -557,6 +677,7 @@ void sdrplay_source_c::set_dc_offset( const std::complex<double> &offset, size_t
 
 double sdrplay_source_c::set_bandwidth( double bandwidth, size_t chan )
 {
+   _dev_mutex.lock();
    if      (bandwidth <= 200e3)  _dev->bwType = mir_sdr_BW_0_200;
    else if (bandwidth <= 300e3)  _dev->bwType = mir_sdr_BW_0_300;
    else if (bandwidth <= 600e3)  _dev->bwType = mir_sdr_BW_0_600;
@@ -568,8 +689,9 @@ double sdrplay_source_c::set_bandwidth( double bandwidth, size_t chan )
 
    if (_running) 
    {
-      reinit_device();
+      request_restart();
    }
+   _dev_mutex.unlock();
 
    return get_bandwidth( chan );
 }
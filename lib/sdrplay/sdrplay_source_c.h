@@ -26,8 +26,10 @@
 #include <gnuradio/thread/thread.h>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/atomic.hpp>
 
 #include "osmosdr/ranges.h"
+#include "spsc_ring.h"
 
 #include "source_iface.h"
 
@@ -78,10 +80,18 @@ private:
 public:
    ~sdrplay_source_c ();	// public destructor
 
+   bool start();
+   bool stop();
+
    int work( int noutput_items,
             gr_vector_const_void_star &input_items,
             gr_vector_void_star &output_items );
 
+   /* packets that did not fit into the FIFO and the samples lost with
+    * them, both counted since the device was opened */
+   unsigned long get_overruns( size_t mboard = 0 ) { return _overflows; }
+   uint64_t get_dropped_samples( size_t mboard = 0 ) { return _dropped; }
+
    static std::vector< std::string > get_devices();
 
    size_t get_num_channels( void );
@@ -118,18 +128,31 @@ public:
    osmosdr::freq_range_t get_bandwidth_range( size_t chan = 0 );
 
 private:
-   void reinit_device(void);
+   static void _sdrplay_reader(sdrplay_source_c *obj);
+   void sdrplay_reader(void);
+   bool reinit_device(void);
+   void request_restart(void);
    void set_gain_limits(double freq);
 
    sdrplay_dev_t *_dev;
+   boost::mutex _dev_mutex;
 
+   /* owned by the reader thread */
    std::vector< short > _bufi;
    std::vector< short > _bufq;
-   int _buf_offset;
-   boost::mutex _buf_mutex;
 
-   bool _running;
-   bool _uninit;
+   gr_complex *_fifo;
+   spsc_ring _fifo_ring;
+   gr::thread::thread _thread;
+
+   boost::atomic< bool > _reading;
+   boost::atomic< bool > _running;
+   boost::atomic< bool > _restart;
+   boost::atomic< bool > _flush;
+
+   boost::atomic< unsigned long > _overflows;
+   boost::atomic< unsigned long > _dropped;
+
    bool _auto_gain;
 };
 
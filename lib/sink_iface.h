@@ -363,6 +363,27 @@ public:
    * \param time_spec the new time
    */
   virtual void set_time_unknown_pps(const ::osmosdr::time_spec_t &time_spec) { }
+
+  /*!
+   * Get how often the device ran out of samples since the stream started.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the count, 0 if the device does not track underruns
+   */
+  virtual unsigned long get_underruns(size_t mboard = 0) { return 0; }
+
+  /*!
+   * Get the seconds of samples buffered between block and device.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the latency, 0 if unknown
+   */
+  virtual double get_latency(size_t mboard = 0) { return 0; }
+
+  /*!
+   * Get the highest latency seen since the stream started.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the latency, defaults to the current one
+   */
+  virtual double get_max_latency(size_t mboard = 0) { return get_latency( mboard ); }
 };
 
 #endif // OSMOSDR_SINK_IFACE_H
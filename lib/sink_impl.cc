@@ -699,3 +699,18 @@ void sink_impl::set_time_unknown_pps(const osmosdr::time_spec_t &time_spec)
     dev->set_time_unknown_pps( time_spec );
   }
 }
+
+unsigned long sink_impl::get_underruns(size_t mboard)
+{
+  return _devs.at(mboard)->get_underruns( mboard );
+}
+
+double sink_impl::get_latency(size_t mboard)
+{
+  return _devs.at(mboard)->get_latency( mboard );
+}
+
+double sink_impl::get_max_latency(size_t mboard)
+{
+  return _devs.at(mboard)->get_max_latency( mboard );
+}
@@ -82,6 +82,10 @@ public:
   void set_time_next_pps(const ::osmosdr::time_spec_t &time_spec);
   void set_time_unknown_pps(const ::osmosdr::time_spec_t &time_spec);
 
+  unsigned long get_underruns(size_t mboard = 0);
+  double get_latency(size_t mboard = 0);
+  double get_max_latency(size_t mboard = 0);
+
 private:
   std::vector< sink_iface * > _devs;
 
@@ -0,0 +1,106 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+#include "soapy_common.h"
+#include <SoapySDR/Device.hpp>
+
+static const char *_names[] = { "CF32", "CS16", "CS12", "CS8" };
+static const size_t _sizes[] = { 8, 4, 3, 2 };
+
+/* nominal full scale values, for formats the device does not use natively */
+static const double _full_scales[] = { 1.0, 32768.0, 2048.0, 128.0 };
+
+static const size_t _num_formats = sizeof(_names) / sizeof(_names[0]);
+
+boost::mutex &get_soapy_maker_mutex(void)
+{
+    static boost::mutex m;
+    return m;
+}
+
+static bool parse_format(const std::string &name, soapy_format_t &format)
+{
+    for (size_t i = 0; i < _num_formats; i++)
+    {
+        if (boost::iequals(name, _names[i]))
+        {
+            format = soapy_format_t(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+soapy_format_t soapy_select_format(SoapySDR::Device *device, int direction,
+                                   const std::string &requested,
+                                   double &full_scale)
+{
+    soapy_format_t format = SOAPY_FORMAT_CF32;
+    const std::vector<std::string> offered = device->getStreamFormats(direction, 0);
+    double native_scale = 0.0;
+    const std::string native = device->getNativeStreamFormat(direction, 0, native_scale);
+
+    if (!requested.empty())
+    {
+        if (!parse_format(requested, format))
+            throw std::runtime_error("Unsupported stream format '" + requested +
+                                     "', use cf32, cs16, cs12 or cs8.");
+    }
+    else if (!parse_format(native, format))
+    {
+        format = SOAPY_FORMAT_CF32;
+    }
+
+    if (format != SOAPY_FORMAT_CF32 &&
+        std::find(offered.begin(), offered.end(), _names[format]) == offered.end())
+    {
+        if (!requested.empty())
+            std::cerr << "SoapySDR: the device does not offer " << _names[format]
+                      << ", falling back to CF32" << std::endl;
+        format = SOAPY_FORMAT_CF32;
+    }
+
+    full_scale = _full_scales[format];
+    if (native == _names[format] && native_scale > 0.0)
+        full_scale = native_scale;
+
+    return format;
+}
+
+const char *soapy_format_name(soapy_format_t format)
+{
+    return _names[format];
+}
+
+size_t soapy_format_size(soapy_format_t format)
+{
+    return _sizes[format];
+}
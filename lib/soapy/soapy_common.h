@@ -0,0 +1,62 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef INCLUDED_SOAPY_COMMON_H
+#define INCLUDED_SOAPY_COMMON_H
+
+#include <stddef.h>
+
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+
+namespace SoapySDR
+{
+    class Device;
+}
+
+/* the stream formats we convert ourselves, CF32 leaves it to the driver */
+enum soapy_format_t
+{
+    SOAPY_FORMAT_CF32 = 0,
+    SOAPY_FORMAT_CS16,
+    SOAPY_FORMAT_CS12,
+    SOAPY_FORMAT_CS8
+};
+
+boost::mutex &get_soapy_maker_mutex(void);
+
+/*!
+ * Picks the stream format for the given direction. Without a request the
+ * native format of the first channel is used if we can convert it, so the
+ * driver hands over its samples untouched. A request (cf32, cs16, cs12 or
+ * cs8) overrides that, as long as the driver offers the format. full_scale
+ * receives the value the driver uses for a full scale sample.
+ */
+soapy_format_t soapy_select_format(SoapySDR::Device *device, int direction,
+                                   const std::string &requested,
+                                   double &full_scale);
+
+/* the SoapySDR name of a format ("CS16", ...) */
+const char *soapy_format_name(soapy_format_t format);
+
+/* bytes per complex sample */
+size_t soapy_format_size(soapy_format_t format);
+
+#endif /* INCLUDED_SOAPY_COMMON_H */
@@ -37,17 +37,13 @@
 #include <gnuradio/io_signature.h>
 
 #include "arg_helpers.h"
+#include "convert.h"
+#include "soapy_common.h"
 #include "soapy_sink_c.h"
 #include <SoapySDR/Device.hpp>
 
 using namespace boost::assign;
 
-boost::mutex &get_soapy_maker_mutex(void)
-{
-    static boost::mutex m;
-    return m;
-}
-
 /*
  * Create a new instance of soapy_sink_c and return
  * a boost shared_ptr.  This is effectively the public constructor.
@@ -65,14 +61,24 @@ soapy_sink_c::soapy_sink_c (const std::string &args)
                     args_to_io_signature(args),
                     gr::io_signature::make (0, 0, 0))
 {
+    dict_t dict = params_to_dict(args);
+    std::string format;
+    if (dict.count("format"))
+    {
+        format = dict["format"];
+        dict.erase("format");
+    }
     {
         boost::mutex::scoped_lock l(get_soapy_maker_mutex());
-        _device = SoapySDR::Device::make(params_to_dict(args));
+        _device = SoapySDR::Device::make(dict);
     }
     _nchan = std::max(1, args_to_io_signature(args)->max_streams());
     std::vector<size_t> channels;
     for (size_t i = 0; i < _nchan; i++) channels.push_back(i);
-    _stream = _device->setupStream(SOAPY_SDR_TX, "CF32", channels);
+    _format = soapy_select_format(_device, SOAPY_SDR_TX, format, _full_scale);
+    _stream = _device->setupStream(SOAPY_SDR_TX, soapy_format_name(_format), channels);
+    _conv_len = 0;
+    std::cerr << "SoapySDR: transmitting " << soapy_format_name(_format) << " samples" << std::endl;
 }
 
 soapy_sink_c::~soapy_sink_c(void)
@@ -84,6 +90,19 @@ soapy_sink_c::~soapy_sink_c(void)
 
 bool soapy_sink_c::start()
 {
+    /* one MTU at least, larger requests are clipped in work() */
+    if (_format != SOAPY_FORMAT_CF32)
+    {
+        _conv_len = std::max(_device->getStreamMTU(_stream), size_t(16384));
+        _conv_bufs.resize(_nchan);
+        _conv_ptrs.resize(_nchan);
+        for (size_t i = 0; i < _nchan; i++)
+        {
+            _conv_bufs[i].resize(_conv_len * soapy_format_size(_format));
+            _conv_ptrs[i] = &_conv_bufs[i][0];
+        }
+    }
+
     return _device->activateStream(_stream) == 0;
 }
 
@@ -98,9 +117,38 @@ int soapy_sink_c::work( int noutput_items,
 {
     int flags = 0;
     long long timeNs = 0;
+
+    if (_format == SOAPY_FORMAT_CF32)
+    {
+        int ret = _device->writeStream(
+            _stream, &input_items[0],
+            noutput_items, flags, timeNs);
+
+        if (ret < 0) return 0; //call again
+        return ret;
+    }
+
+    /* what the driver does not take is converted again in the next call */
+    const int count = std::min(noutput_items, int(_conv_len));
+    const float scale = float(_full_scale);
+    for (size_t i = 0; i < _nchan; i++)
+    {
+        const gr_complex *in = (const gr_complex *)input_items[i];
+        void *out = &_conv_bufs[i][0];
+        switch (_format)
+        {
+        case SOAPY_FORMAT_CS16:
+            convert_cf32_to_cs16(in, out, count, scale, std::min(scale, 32768.0f) - 1.0f);
+            break;
+        case SOAPY_FORMAT_CS12: convert_cf32_to_cs12(in, out, count, scale); break;
+        case SOAPY_FORMAT_CS8: convert_cf32_to_cs8(in, out, count, scale); break;
+        default: break;
+        }
+    }
+
     int ret = _device->writeStream(
-        _stream, &input_items[0],
-        noutput_items, flags, timeNs);
+        _stream, &_conv_ptrs[0],
+        count, flags, timeNs);
 
     if (ret < 0) return 0; //call again
     return ret;
@@ -24,8 +24,11 @@
 #include <gnuradio/block.h>
 #include <gnuradio/sync_block.h>
 
+#include <vector>
+
 #include "osmosdr/ranges.h"
 #include "sink_iface.h"
+#include "soapy_common.h"
 
 class soapy_sink_c;
 
@@ -133,6 +136,11 @@ private:
     SoapySDR::Device *_device;
     SoapySDR::Stream *_stream;
     size_t _nchan;
+    soapy_format_t _format;
+    double _full_scale;
+    size_t _conv_len; /* samples per channel in _conv_bufs */
+    std::vector< std::vector<char> > _conv_bufs;
+    std::vector<const void *> _conv_ptrs;
 };
 
 #endif /* INCLUDED_SOAPY_SINK_C_H */
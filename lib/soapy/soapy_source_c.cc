@@ -37,14 +37,14 @@
 #include <gnuradio/io_signature.h>
 
 #include "arg_helpers.h"
+#include "convert.h"
+#include "soapy_common.h"
 #include "soapy_source_c.h"
 #include "osmosdr/source.h"
 #include <SoapySDR/Device.hpp>
 
 using namespace boost::assign;
 
-boost::mutex &get_soapy_maker_mutex(void);
-
 /*
  * Create a new instance of soapy_source_c and return
  * a boost shared_ptr.  This is effectively the public constructor.
@@ -62,14 +62,24 @@ soapy_source_c::soapy_source_c (const std::string &args)
                     gr::io_signature::make (0, 0, 0),
                     args_to_io_signature(args))
 {
+    dict_t dict = params_to_dict(args);
+    std::string format;
+    if (dict.count("format"))
+    {
+        format = dict["format"];
+        dict.erase("format");
+    }
     {
         boost::mutex::scoped_lock l(get_soapy_maker_mutex());
-        _device = SoapySDR::Device::make(params_to_dict(args));
+        _device = SoapySDR::Device::make(dict);
     }
     _nchan = std::max(1, args_to_io_signature(args)->max_streams());
     std::vector<size_t> channels;
     for (size_t i = 0; i < _nchan; i++) channels.push_back(i);
-    _stream = _device->setupStream(SOAPY_SDR_RX, "CF32", channels);
+    _format = soapy_select_format(_device, SOAPY_SDR_RX, format, _full_scale);
+    _stream = _device->setupStream(SOAPY_SDR_RX, soapy_format_name(_format), channels);
+    _raw.resize(_nchan);
+    std::cerr << "SoapySDR: receiving " << soapy_format_name(_format) << " samples" << std::endl;
 }
 
 soapy_source_c::~soapy_source_c(void)
@@ -95,11 +105,45 @@ int soapy_source_c::work( int noutput_items,
 {
     int flags = 0;
     long long timeNs = 0;
+
+    if (_format == SOAPY_FORMAT_CF32)
+    {
+        int ret = _device->readStream(
+            _stream, &output_items[0],
+            noutput_items, flags, timeNs);
+
+        if (ret < 0) return 0; //call again
+        return ret;
+    }
+
+    /*
+     * The native samples are smaller than their gr_complex counterparts,
+     * so they are received into the upper end of each output buffer and
+     * widened in place. The conversion runs front to back and never
+     * overwrites input it has not read yet.
+     */
+    const size_t offset = noutput_items * (sizeof(gr_complex) - soapy_format_size(_format));
+    for (size_t i = 0; i < _nchan; i++)
+        _raw[i] = (char *)output_items[i] + offset;
+
     int ret = _device->readStream(
-        _stream, &output_items[0],
+        _stream, &_raw[0],
         noutput_items, flags, timeNs);
 
     if (ret < 0) return 0; //call again
+
+    const float scale = float(1.0 / _full_scale);
+    for (size_t i = 0; i < _nchan; i++)
+    {
+        gr_complex *out = (gr_complex *)output_items[i];
+        switch (_format)
+        {
+        case SOAPY_FORMAT_CS16: convert_cs16_to_cf32(_raw[i], out, ret, scale); break;
+        case SOAPY_FORMAT_CS12: convert_cs12_to_cf32(_raw[i], out, ret, scale); break;
+        case SOAPY_FORMAT_CS8: convert_cs8_to_cf32(_raw[i], out, ret, scale); break;
+        default: break;
+        }
+    }
     return ret;
 }
 
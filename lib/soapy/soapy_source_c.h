@@ -24,8 +24,11 @@
 #include <gnuradio/block.h>
 #include <gnuradio/sync_block.h>
 
+#include <vector>
+
 #include "osmosdr/ranges.h"
 #include "source_iface.h"
+#include "soapy_common.h"
 
 class soapy_source_c;
 
@@ -135,6 +138,9 @@ private:
     SoapySDR::Device *_device;
     SoapySDR::Stream *_stream;
     size_t _nchan;
+    soapy_format_t _format;
+    double _full_scale;
+    std::vector<void *> _raw; /* where each channel is received to */
 };
 
 #endif /* INCLUDED_SOAPY_SOURCE_C_H */
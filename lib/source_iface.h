@@ -395,6 +395,45 @@ public:
    * \param time_spec the new time
    */
   virtual void set_time_unknown_pps(const ::osmosdr::time_spec_t &time_spec) { }
+
+  /*!
+   * Get the number of samples the device lost since it was opened.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the cumulative count, 0 if the device does not track losses
+   */
+  virtual uint64_t get_dropped_samples(size_t mboard = 0) { return 0; }
+
+  /*!
+   * Get how often the buffers between device and block ran full.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the count since the device was opened, 0 if not tracked
+   */
+  virtual unsigned long get_overruns(size_t mboard = 0) { return 0; }
+
+  /*!
+   * Get how often the device stalled and delivered no samples.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the count since the device was opened, 0 if not tracked
+   */
+  virtual unsigned long get_underruns(size_t mboard = 0) { return 0; }
+
+  /*!
+   * Get the seconds of samples buffered between device and block.
+   * \param mboard the motherboard index 0 to M-1
+   * \return the latency, 0 if unknown
+   */
+  virtual double get_latency(size_t mboard = 0) { return 0; }
+
+  /*!
+   * Get the hardware timestamp of the latest block of samples.
+   * \param item receives the absolute index of its first sample
+   * \param timestamp receives the timestamp in device ticks
+   * \param dropped receives the samples lost to overruns so far
+   * \param mboard the motherboard index 0 to M-1
+   * \return false if the device does not timestamp its samples
+   */
+  virtual bool get_rx_timestamp(uint64_t &item, uint64_t &timestamp,
+                                uint64_t &dropped, size_t mboard = 0) { return false; }
 };
 
 #endif // OSMOSDR_SOURCE_IFACE_H
@@ -966,3 +966,29 @@ void source_impl::set_time_unknown_pps(const osmosdr::time_spec_t &time_spec)
     dev->set_time_unknown_pps( time_spec );
   }
 }
+
+uint64_t source_impl::get_dropped_samples(size_t mboard)
+{
+  return _devs.at(mboard)->get_dropped_samples( mboard );
+}
+
+unsigned long source_impl::get_overruns(size_t mboard)
+{
+  return _devs.at(mboard)->get_overruns( mboard );
+}
+
+unsigned long source_impl::get_underruns(size_t mboard)
+{
+  return _devs.at(mboard)->get_underruns( mboard );
+}
+
+double source_impl::get_latency(size_t mboard)
+{
+  return _devs.at(mboard)->get_latency( mboard );
+}
+
+bool source_impl::get_rx_timestamp(uint64_t &item, uint64_t &timestamp,
+                                   uint64_t &dropped, size_t mboard)
+{
+  return _devs.at(mboard)->get_rx_timestamp( item, timestamp, dropped, mboard );
+}
@@ -91,6 +91,13 @@ public:
   void set_time_next_pps(const ::osmosdr::time_spec_t &time_spec);
   void set_time_unknown_pps(const ::osmosdr::time_spec_t &time_spec);
 
+  uint64_t get_dropped_samples(size_t mboard = 0);
+  unsigned long get_overruns(size_t mboard = 0);
+  unsigned long get_underruns(size_t mboard = 0);
+  double get_latency(size_t mboard = 0);
+  bool get_rx_timestamp(uint64_t &item, uint64_t &timestamp,
+                        uint64_t &dropped, size_t mboard = 0);
+
 private:
   std::vector< source_iface * > _devs;
 
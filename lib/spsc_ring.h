@@ -0,0 +1,245 @@
+/* -*- c++ -*- */
+/*
+ * This file is part of GNU Radio
+ *
+ * GNU Radio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * GNU Radio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef OSMOSDR_SPSC_RING_H
+#define OSMOSDR_SPSC_RING_H
+
+#include <stddef.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#define SPSC_CACHE_LINE 64
+
+/*!
+ * Index bookkeeping for a single producer / single consumer ring of
+ * fixed size slots. The storage itself is owned by the caller, the ring
+ * only hands out slot numbers. A slot may be a whole transfer buffer or
+ * a single sample, in the latter case push() and pop() move n slots at
+ * once and the caller copies in up to two segments around the wrap.
+ *
+ * The side driven by the hardware (typically a driver callback) never
+ * blocks and never takes a lock unless the other side is parked. Head
+ * and tail live on separate cache lines so the two threads do not bounce
+ * them between cores. The consumer may spin for a while before it parks
+ * on a condition variable, trading CPU time for wakeup latency. For
+ * transmit paths the roles swap and the producer waits for free slots.
+ *
+ * Head and tail count modulo twice the number of slots, which tells a
+ * full ring from an empty one and, unlike free running counters, keeps
+ * the slot mapping intact for any ring size on 32 bit hosts.
+ */
+class spsc_ring
+{
+public:
+  spsc_ring( size_t slots = 1 )
+    : _slots( slots ? slots : 1 ), _head( 0 ), _tail( 0 ),
+      _waiting( false ), _stopped( false )
+  {
+  }
+
+  /* only valid while neither side is running */
+  void reset( size_t slots )
+  {
+    _slots = slots ? slots : 1;
+    _head.store( 0 );
+    _tail.store( 0 );
+    _stopped.store( false );
+  }
+
+  size_t capacity() const { return _slots; }
+
+  size_t size() const
+  {
+    return distance( _tail.load( boost::memory_order_acquire ),
+                     _head.load( boost::memory_order_acquire ) );
+  }
+
+  /* producer side */
+
+  bool full() const
+  {
+    return space() == 0;
+  }
+
+  /* number of free slots */
+  size_t space() const
+  {
+    return _slots - distance( _tail.load( boost::memory_order_relaxed ),
+                              _head.load( boost::memory_order_acquire ) );
+  }
+
+  /* slot to fill next, only valid if ! full() */
+  size_t tail() const
+  {
+    return slot( _tail.load( boost::memory_order_relaxed ) );
+  }
+
+  /* publishes n slots starting at tail() */
+  void push( size_t n = 1 )
+  {
+    _tail.store( advance( _tail.load( boost::memory_order_relaxed ), n ),
+                 boost::memory_order_seq_cst );
+
+    if ( _waiting.load( boost::memory_order_seq_cst ) )
+      wake();
+  }
+
+  /* consumer side */
+
+  /* oldest filled slot, only valid if size() > 0 */
+  size_t head() const
+  {
+    return slot( _head.load( boost::memory_order_relaxed ) );
+  }
+
+  /* returns n slots starting at head() to the producer */
+  void pop( size_t n = 1 )
+  {
+    _head.store( advance( _head.load( boost::memory_order_relaxed ), n ),
+                 boost::memory_order_seq_cst );
+
+    if ( _waiting.load( boost::memory_order_seq_cst ) )
+      wake();
+  }
+
+  /*!
+   * Blocks the consumer until at least count slots are filled or stop()
+   * was called. Polls for up to spin_usec microseconds before parking the
+   * thread. A non-zero timeout_usec bounds the whole wait, the caller has
+   * to check size() afterwards. Returns false if the ring was stopped.
+   */
+  bool wait( size_t count, unsigned int spin_usec = 0,
+             unsigned int timeout_usec = 0 )
+  {
+    return wait_for( count, false, spin_usec, timeout_usec );
+  }
+
+  /* the same for a producer waiting on count free slots */
+  bool wait_space( size_t count, unsigned int spin_usec = 0,
+                   unsigned int timeout_usec = 0 )
+  {
+    return wait_for( count, true, spin_usec, timeout_usec );
+  }
+
+  /* releases a waiting thread for good, until the next reset() or resume() */
+  void stop()
+  {
+    _stopped.store( true );
+    wake();
+  }
+
+  /* undoes stop() while the other side keeps running, the content is kept */
+  void resume()
+  {
+    _stopped.store( false );
+  }
+
+private:
+  /* counters live in [0, 2 * _slots) */
+  size_t slot( size_t count ) const
+  {
+    return count < _slots ? count : count - _slots;
+  }
+
+  size_t advance( size_t count, size_t n ) const
+  {
+    count += n;
+    return count < 2 * _slots ? count : count - 2 * _slots;
+  }
+
+  size_t distance( size_t tail, size_t head ) const
+  {
+    return tail >= head ? tail - head : tail + 2 * _slots - head;
+  }
+
+  bool ready( size_t count, bool space_wanted ) const
+  {
+    return ( space_wanted ? space() : size() ) >= count;
+  }
+
+  bool wait_for( size_t count, bool space_wanted, unsigned int spin_usec,
+                 unsigned int timeout_usec )
+  {
+    using namespace boost::posix_time;
+
+    if ( ready( count, space_wanted ) )
+      return true;
+
+    ptime start = microsec_clock::universal_time();
+
+    if ( spin_usec ) {
+      ptime deadline = start + microseconds( spin_usec );
+
+      do {
+        for ( int i = 0; i < 64; i++ )
+          if ( ready( count, space_wanted ) || _stopped.load( boost::memory_order_relaxed ) )
+            return ! _stopped.load();
+      } while ( microsec_clock::universal_time() < deadline );
+    }
+
+    boost::mutex::scoped_lock lock( _mutex );
+
+    /* the other side reads _waiting after publishing, see push() and pop() */
+    _waiting.store( true, boost::memory_order_seq_cst );
+    boost::atomic_thread_fence( boost::memory_order_seq_cst );
+
+    ptime deadline = start + microseconds( timeout_usec );
+
+    while ( ! ready( count, space_wanted ) && ! _stopped.load() ) {
+      if ( ! timeout_usec )
+        _cond.wait( lock );
+      else if ( ! _cond.timed_wait( lock, deadline ) )
+        break;
+    }
+
+    _waiting.store( false, boost::memory_order_relaxed );
+
+    return ! _stopped.load();
+  }
+
+  void wake()
+  {
+    {
+      boost::mutex::scoped_lock lock( _mutex );
+    }
+    _cond.notify_one();
+  }
+
+  size_t _slots;
+
+  /* consumer owned */
+  char _pad0[SPSC_CACHE_LINE];
+  boost::atomic< size_t > _head;
+  char _pad1[SPSC_CACHE_LINE - sizeof(boost::atomic< size_t >)];
+
+  /* producer owned */
+  boost::atomic< size_t > _tail;
+  char _pad2[SPSC_CACHE_LINE - sizeof(boost::atomic< size_t >)];
+
+  boost::atomic< bool > _waiting;
+  boost::atomic< bool > _stopped;
+  boost::mutex _mutex;
+  boost::condition_variable _cond;
+};
+
+#endif // OSMOSDR_SPSC_RING_H
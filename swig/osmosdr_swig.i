@@ -70,6 +70,10 @@ BASE_NAME = BASE_NAME.make;
 %}
 %enddef
 
+// get_rx_timestamp() returns (valid, item, timestamp, dropped) in python
+%include "typemaps.i"
+%apply uint64_t &OUTPUT { uint64_t &item, uint64_t &timestamp, uint64_t &dropped };
+
 %include "osmosdr/source.h"
 %include "osmosdr/sink.h"
 